@@ -0,0 +1,123 @@
+// Check of the shared filter states of prefixscan against the smoother of every separately built telescope
+
+#include "assembly.h"
+#include "constants.h"
+#include "log.h"
+#include "materials.h"
+#include "prefixscan.h"
+#include "smoother.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <iostream>
+
+using namespace std;
+using namespace gblsim;
+using namespace unilog;
+
+int main(int argc, char* argv[]) {
+
+    /*
+     * DATURA-like telescope with six MIMOSA26 planes and a DUT moved in 200 steps between the arms, every second DUT
+     * position tilted, for pions without and protons with mass. A second scan with volume segments changes only the
+     * last plane. The resolution at the target plane of every configuration has to equal the smoother of the telescope
+     * built from the same planes. Returns 1 otherwise.
+     */
+
+    // Add cout as the default logging stream, without the INFO messages of the hundreds of telescopes built:
+    Log::addStream(std::cout);
+    Log::setReportingLevel(LogLevel::WARNING);
+
+    for(int i = 1; i < argc; i++) {
+        // Setting verbosity:
+        if(std::string(argv[i]) == "-v") {
+            try {
+                LogLevel log_level = Log::getLevelFromString(std::string(argv[++i]));
+                Log::setReportingLevel(log_level);
+            } catch(std::invalid_argument& e) {
+                LOG(ERROR) << "Invalid verbosity level \"" << std::string(argv[i]) << "\", ignoring overwrite";
+            }
+        }
+    }
+
+    // Largest accepted relative difference to the smoother of the full telescope:
+    const double tolerance = 1e-12;
+
+    // MIMOSA26 telescope planes consist of 50um silicon plus 2x25um Kapton foil only:
+    double MIM26 = 55e-3 / X0_Si + 50e-3 / X0_Kapton;
+    double RES = 3.24e-3;
+
+    // Compare the resolutions of all configurations with the smoother of the separately built telescope:
+    auto compare = [&](prefixscan& scan,
+                       const std::vector<std::vector<plane>>& configurations,
+                       size_t target,
+                       const std::function<telescope(const std::vector<plane>&)>& build) {
+        auto results = scan.evaluate();
+        double difference = 0.;
+        for(size_t n = 0; n < configurations.size(); n++) {
+            auto tel = build(configurations[n]);
+            for(size_t axis = 0; axis < 2; axis++) {
+                smoother reference(tel.getChain(), axis);
+                double expected = std::sqrt(reference.getCovariance(tel.getChainPoint(target))(0, 0)) * 1E3;
+                double result = (axis == 0 ? results[n].first : results[n].second);
+                difference = std::max(difference, std::abs(result - expected) / expected);
+            }
+        }
+        LOG(STATUS) << configurations.size() << " configurations: largest relative difference " << difference << ", "
+                    << scan.getSteps() << " filter steps instead of " << scan.getUnsharedSteps();
+        return difference;
+    };
+
+    double worst = 0.;
+
+    // DUT position scan, the DUT is the fourth plane in z:
+    double BEAM = 2.0;
+    for(double mass : {0., 0.938272}) {
+        LOG(STATUS) << "DUT position scan with particle mass " << mass << " GeV:";
+        prefixscan scan(BEAM, X0_Air, mass);
+        std::vector<std::vector<plane>> configurations;
+        for(size_t n = 0; n < 200; n++) {
+            std::vector<plane> planes;
+            for(size_t i = 0; i < 3; i++) {
+                planes.push_back(plane::active(20. * static_cast<double>(i), MIM26, RES));
+                planes.push_back(plane::active(300. + 20. * static_cast<double>(i), MIM26, RES));
+            }
+            auto dut = plane::inactive(60. + 1.2 * static_cast<double>(n), 0.01);
+            if(n % 2 == 1) {
+                dut.setTilt({0.5, 0.});
+            }
+            planes.push_back(dut);
+            configurations.push_back(planes);
+            scan.add(planes, 3);
+        }
+        worst = std::max(worst, compare(scan, configurations, 3, [&](const std::vector<plane>& planes) {
+                             return telescope(planes, BEAM, X0_Air, mass);
+                         }));
+    }
+
+    // Scan of the last plane in a telescope with volume segments, evaluated at the second plane:
+    LOG(STATUS) << "Last plane scan with volume segments:";
+    std::vector<volume> volumes = {{0., 100., X0_Air}, {100., 500., 0.}};
+    prefixscan scan(4., volumes);
+    std::vector<std::vector<plane>> configurations;
+    for(const auto& resolution : {RES, 5e-3}) {
+        std::vector<plane> planes;
+        for(size_t i = 0; i < 5; i++) {
+            planes.push_back(plane::active(80. * static_cast<double>(i), MIM26, RES));
+        }
+        planes.push_back(plane::active(420., MIM26, resolution));
+        configurations.push_back(planes);
+        scan.add(planes, 1);
+    }
+    worst = std::max(worst, compare(scan, configurations, 1, [&](const std::vector<plane>& planes) {
+                         return telescope(planes, 4., volumes);
+                     }));
+
+    if(!(worst <= tolerance)) {
+        LOG(ERROR) << "Prefix scan differs from the smoother by " << worst << ", more than " << tolerance;
+        return 1;
+    }
+    LOG(STATUS) << "Prefix scan agrees with the smoother to " << worst;
+    return 0;
+}
@@ -0,0 +1,195 @@
+// Check of the streaming scan pipeline and its sinks against a sequential evaluation and a full sort
+
+#include "assembly.h"
+#include "constants.h"
+#include "log.h"
+#include "materials.h"
+#include "scanspace.h"
+#include "smoother.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+
+using namespace std;
+using namespace gblsim;
+using namespace unilog;
+
+namespace {
+    // Sink passing every result on to several sinks
+    class fanout : public scansink {
+    public:
+        explicit fanout(std::vector<scansink*> sinks) : m_sinks(std::move(sinks)) {}
+        void consume(scanresult result) override {
+            for(auto* sink : m_sinks) {
+                sink->consume(result);
+            }
+        }
+
+    private:
+        std::vector<scansink*> m_sinks;
+    };
+
+    // Sink failing on the given number of results
+    class failingsink : public scansink {
+    public:
+        explicit failingsink(uint64_t limit) : m_limit(limit), m_consumed(0) {}
+        void consume(scanresult) override {
+            if(++m_consumed >= m_limit) {
+                throw std::runtime_error("sink failure");
+            }
+        }
+
+    private:
+        uint64_t m_limit;
+        uint64_t m_consumed;
+    };
+} // namespace
+
+int main(int argc, char* argv[]) {
+
+    /*
+     * Scan of DUT position and material budget between the arms of a DATURA-like telescope, restricted by a filter to
+     * the positions close to the upstream arm for thick DUTs. The space is evaluated by four workers through a queue of
+     * only four results, so the workers are regularly blocked by the sink. The top results by resolution, the top
+     * results by a rounded resolution with many ties and all results below a threshold have to equal those of a
+     * sequential evaluation sorted in full. An evaluator and a sink throwing part way through the scan have to abort
+     * it and pass their exception to the caller. Returns 1 otherwise.
+     */
+
+    // Add cout as the default logging stream, without the INFO messages of the telescopes built:
+    Log::addStream(std::cout);
+    Log::setReportingLevel(LogLevel::WARNING);
+
+    for(int i = 1; i < argc; i++) {
+        // Setting verbosity:
+        if(std::string(argv[i]) == "-v") {
+            try {
+                LogLevel log_level = Log::getLevelFromString(std::string(argv[++i]));
+                Log::setReportingLevel(log_level);
+            } catch(std::invalid_argument& e) {
+                LOG(ERROR) << "Invalid verbosity level \"" << std::string(argv[i]) << "\", ignoring overwrite";
+            }
+        }
+    }
+
+    // MIMOSA26 telescope planes consist of 50um silicon plus 2x25um Kapton foil only:
+    double MIM26 = 55e-3 / X0_Si + 50e-3 / X0_Kapton;
+    double RES = 3.24e-3;
+    double BEAM = 2.0;
+
+    // Resolution at the DUT in [um] and the same rounded to 0.1um:
+    auto evaluate = [&](const std::vector<double>& point) {
+        std::vector<plane> planes;
+        for(size_t i = 0; i < 3; i++) {
+            planes.push_back(plane::active(20. * static_cast<double>(i), MIM26, RES));
+        }
+        planes.push_back(plane::inactive(point[0], point[1]));
+        for(size_t i = 0; i < 3; i++) {
+            planes.push_back(plane::active(300. + 20. * static_cast<double>(i), MIM26, RES));
+        }
+        telescope tel(planes, BEAM);
+        double resolution = std::sqrt(smoother(tel.getChain(), 0).getCovariance(tel.getChainPoint(3))(0, 0)) * 1E3;
+        return std::vector<double>{resolution, std::round(resolution * 10.) / 10.};
+    };
+
+    auto space = scanspace::product(scanspace::range(50., 250., 101), scanspace::values({1e-3, 1e-2, 3e-2, 0.1, 0.3}))
+                     .filter([](const std::vector<double>& point) { return point.at(1) < 0.1 || point.at(0) < 150.; });
+
+    // Sequential reference:
+    std::vector<scanresult> reference;
+    std::vector<double> point;
+    for(uint64_t index = 0; index < space.size(); index++) {
+        if(space.get(index, point)) {
+            reference.push_back({index, point, evaluate(point)});
+        }
+    }
+
+    const size_t count = 25;
+    const double threshold = 15.;
+    topsink smallest(count, 0);
+    topsink rounded(count, 1, true);
+    thresholdsink below(0, threshold);
+    fanout sinks({&smallest, &rounded, &below});
+    auto consumed = scanpipeline(evaluate, 4, 4).run(space, sinks);
+
+    // Compare the indices of the kept results with the fully sorted reference:
+    bool success = true;
+    auto compare = [&](const std::string& name,
+                       const std::vector<scanresult>& results,
+                       std::vector<scanresult> expected,
+                       const auto& order,
+                       size_t keep) {
+        std::sort(expected.begin(), expected.end(), order);
+        expected.resize(std::min(keep, expected.size()));
+        bool equal = (results.size() == expected.size());
+        for(size_t i = 0; equal && i < results.size(); i++) {
+            equal = (results[i].index == expected[i].index && results[i].values == expected[i].values &&
+                     results[i].point == expected[i].point);
+        }
+        LOG(STATUS) << name << ": " << results.size() << " results kept, " << (equal ? "equal to" : "DIFFERENT from")
+                    << " the full sort";
+        success = success && equal;
+    };
+    LOG(STATUS) << consumed << " of " << space.size() << " candidate points evaluated, " << reference.size()
+                << " pass the filter";
+    success = (consumed == reference.size());
+
+    compare("Best resolution",
+            smallest.getResults(),
+            reference,
+            [](const scanresult& a, const scanresult& b) {
+                return a.values[0] != b.values[0] ? a.values[0] < b.values[0] : a.index < b.index;
+            },
+            count);
+    compare("Worst rounded resolution",
+            rounded.getResults(),
+            reference,
+            [](const scanresult& a, const scanresult& b) {
+                return a.values[1] != b.values[1] ? a.values[1] > b.values[1] : a.index < b.index;
+            },
+            count);
+    std::vector<scanresult> selected;
+    std::copy_if(reference.begin(), reference.end(), std::back_inserter(selected), [&](const scanresult& result) {
+        return result.values[0] < threshold;
+    });
+    compare("Resolution below threshold",
+            below.getResults(),
+            selected,
+            [](const scanresult& a, const scanresult& b) { return a.index < b.index; },
+            selected.size());
+
+    // Failing evaluator and sink, the scan has to stop with their exception:
+    auto failing = [&](const std::string& name, const scanpipeline& pipeline, scansink& sink) {
+        try {
+            pipeline.run(space, sink);
+            LOG(ERROR) << name << ": scan completed despite the failure";
+            success = false;
+        } catch(std::runtime_error& e) {
+            LOG(STATUS) << name << ": scan aborted with \"" << e.what() << "\"";
+        }
+    };
+    topsink ignored(count, 0);
+    failing("Failing evaluator",
+            scanpipeline(
+                [&](const std::vector<double>& candidate) {
+                    if(candidate[0] > 200.) {
+                        throw std::runtime_error("evaluator failure");
+                    }
+                    return evaluate(candidate);
+                },
+                4,
+                4),
+            ignored);
+    failingsink broken(100);
+    failing("Failing sink", scanpipeline(evaluate, 4, 4), broken);
+
+    if(!success) {
+        LOG(ERROR) << "Scan pipeline differs from the sequential evaluation";
+        return 1;
+    }
+    LOG(STATUS) << "Scan pipeline agrees with the sequential evaluation";
+    return 0;
+}
@@ -0,0 +1,124 @@
+// Check of the multi-threaded smoother filters against the sequential ones on long random chains
+
+#include "log.h"
+#include "smoother.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <random>
+
+using namespace std;
+using namespace gblsim;
+using namespace unilog;
+
+int main(int argc, char* argv[]) {
+
+    /*
+     * Random chains of 2*10^4 and 10^5 points with thin scatterers, points without scatterer and measurements on about
+     * half of the points, once without and once with a few free kinks, whose segments are stepped point by point.
+     * The covariances at a sample of points and the cross-covariances to their neighbours are computed with one and
+     * with several threads per filter. The largest difference, relative to the diagonal of the sequential result, has
+     * to stay at the level of the floating point rounding. Returns 1 otherwise.
+     */
+
+    // Add cout as the default logging stream
+    Log::addStream(std::cout);
+    Log::setReportingLevel(LogLevel::INFO);
+
+    for(int i = 1; i < argc; i++) {
+        // Setting verbosity:
+        if(std::string(argv[i]) == "-v") {
+            try {
+                LogLevel log_level = Log::getLevelFromString(std::string(argv[++i]));
+                Log::setReportingLevel(log_level);
+            } catch(std::invalid_argument& e) {
+                LOG(ERROR) << "Invalid verbosity level \"" << std::string(argv[i]) << "\", ignoring overwrite";
+            }
+        }
+    }
+
+    // Largest accepted relative difference between parallel and sequential covariances. Composing the segment maps
+    // accumulates rounding over the segment length, about 1e-12 for segments of 10^4 points:
+    const double tolerance = 1e-11;
+    // Threads used for the parallel filters, independent of the number of cores to always split the chains:
+    const size_t threads = 8;
+
+    std::mt19937_64 random(42);
+    std::uniform_real_distribution<double> uniform(0., 1.);
+
+    double worst = 0.;
+    // Number of points and of free kinks of every chain:
+    std::vector<std::pair<size_t, size_t>> chains = {{20000, 0}, {100000, 0}, {100000, 3}};
+    for(const auto& configuration : chains) {
+        auto points = configuration.first;
+        std::vector<size_t> free;
+        for(size_t f = 0; f < configuration.second; f++) {
+            free.push_back(static_cast<size_t>(uniform(random) * static_cast<double>(points)));
+        }
+
+        chain trajectory;
+        double position = 0.;
+        for(size_t k = 0; k < points; k++) {
+            position += 1. + 49. * uniform(random);
+
+            // Kink precision of a scattering angle between 0.1 and 1 mrad, no scatterer or a free kink:
+            double theta = 1e-4 * std::pow(10., uniform(random));
+            double scatterer = uniform(random) < 0.1 ? std::numeric_limits<double>::infinity() : 1. / theta / theta;
+            scatterer = std::find(free.begin(), free.end(), k) != free.end() ? 0. : scatterer;
+
+            double measurement = uniform(random) < 0.5 ? 1. / 3.24e-3 / 3.24e-3 : 0.;
+            trajectory.addPoint(position, scatterer, {measurement, measurement});
+        }
+
+        // Points to compare, including both ends:
+        std::vector<size_t> sample = {0, points - 1};
+        for(size_t s = 0; s < 1000; s++) {
+            sample.push_back(static_cast<size_t>(uniform(random) * static_cast<double>(points - 1)));
+        }
+
+        for(size_t axis = 0; axis < 2; axis++) {
+            smoother sequential(trajectory, axis, 1);
+            smoother parallel(trajectory, axis, threads);
+
+            double difference = 0.;
+            size_t compared = 0;
+            auto compare = [&](const Eigen::Matrix2d& reference, const Eigen::Matrix2d& result, const Eigen::Matrix2d& a,
+                               const Eigen::Matrix2d& b) {
+                for(Eigen::Index i = 0; i < 2; i++) {
+                    for(Eigen::Index j = 0; j < 2; j++) {
+                        double scale = std::sqrt(a(i, i) * b(j, j));
+                        if(!std::isfinite(scale) || !(scale > 0.)) {
+                            continue;
+                        }
+                        difference = std::max(difference, std::abs(result(i, j) - reference(i, j)) / scale);
+                        compared++;
+                    }
+                }
+            };
+            for(const auto& point : sample) {
+                auto reference = sequential.getCovariance(point);
+                compare(reference, parallel.getCovariance(point), reference, reference);
+                if(point + 1 < points) {
+                    auto next = sequential.getCovariance(point + 1);
+                    compare(sequential.getCovariance(point, point + 1),
+                            parallel.getCovariance(point, point + 1),
+                            reference,
+                            next);
+                }
+            }
+
+            LOG(STATUS) << points << " points with " << free.size() << " free kinks, axis " << axis << ": " << compared
+                        << " covariance entries compared, largest relative difference " << difference;
+            worst = std::max(worst, difference);
+        }
+    }
+
+    if(!(worst <= tolerance)) {
+        LOG(ERROR) << "Parallel smoother differs from the sequential one by " << worst << ", more than " << tolerance;
+        return 1;
+    }
+    LOG(STATUS) << "Parallel smoother agrees with the sequential one to " << worst;
+    return 0;
+}
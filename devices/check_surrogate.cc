@@ -0,0 +1,151 @@
+// Check of the surrogate error bound, the file round trip and the detection of stale surrogates
+
+#include "assembly.h"
+#include "constants.h"
+#include "log.h"
+#include "materials.h"
+#include "smoother.h"
+#include "surrogate.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+
+using namespace std;
+using namespace gblsim;
+using namespace unilog;
+
+int main(int argc, char* argv[]) {
+
+    /*
+     * Surrogate of the resolution at a DUT between the arms of a DATURA-like telescope as function of the DUT material
+     * budget on a logarithmic axis and of its position. The deviation from the full calculation at random points has to
+     * stay within the error bound. The surrogate written to file and read back has to give identical values and carry
+     * the hash of its telescope template, which has to differ from the template at another beam energy. Invalid
+     * parameter ranges and a failing function have to throw. Returns 1 otherwise.
+     */
+
+    // Add cout as the default logging stream, without the INFO messages of the telescopes built:
+    Log::addStream(std::cout);
+    Log::setReportingLevel(LogLevel::WARNING);
+
+    std::string path = "check_surrogate.sur";
+    for(int i = 1; i < argc; i++) {
+        // Setting verbosity:
+        if(std::string(argv[i]) == "-v") {
+            try {
+                LogLevel log_level = Log::getLevelFromString(std::string(argv[++i]));
+                Log::setReportingLevel(log_level);
+            } catch(std::invalid_argument& e) {
+                LOG(ERROR) << "Invalid verbosity level \"" << std::string(argv[i]) << "\", ignoring overwrite";
+            }
+        } else if(std::string(argv[i]) == "-o" && i + 1 < argc) {
+            // Temporary surrogate file:
+            path = std::string(argv[++i]);
+        }
+    }
+
+    // MIMOSA26 telescope planes consist of 50um silicon plus 2x25um Kapton foil only:
+    double MIM26 = 55e-3 / X0_Si + 50e-3 / X0_Kapton;
+    double RES = 3.24e-3;
+
+    // Telescope with the DUT of the given x/X0 at the given position, the template has a DUT of 1% X0 in the center:
+    auto build = [&](double material, double position, double energy) {
+        std::vector<plane> planes;
+        for(size_t i = 0; i < 3; i++) {
+            planes.push_back(plane::active(20. * static_cast<double>(i), MIM26, RES));
+        }
+        planes.push_back(plane::inactive(position, material));
+        for(size_t i = 0; i < 3; i++) {
+            planes.push_back(plane::active(300. + 20. * static_cast<double>(i), MIM26, RES));
+        }
+        return telescope(planes, energy);
+    };
+    auto resolution = [&](const std::vector<double>& parameters) {
+        auto tel = build(parameters[0], parameters[1], 2.);
+        return std::sqrt(smoother(tel.getChain(), 0).getCovariance(tel.getChainPoint(3))(0, 0)) * 1E3;
+    };
+    auto hash = build(1e-2, 150., 2.).getHash();
+    std::vector<surrogateaxis> axes = {{1e-3, 1., true}, {50., 250., false}};
+
+    const double tolerance = 1e-2;
+    surrogate approximation(resolution, axes, hash, tolerance);
+    LOG(STATUS) << "Surrogate of degrees " << approximation.getDegrees()[0] << " x " << approximation.getDegrees()[1]
+                << " from " << approximation.getEvaluations() << " evaluations, error bound "
+                << approximation.getErrorBound() << " um";
+
+    bool success = true;
+    if(!(approximation.getErrorBound() <= tolerance)) {
+        LOG(ERROR) << "Error bound exceeds the tolerance of " << tolerance << " um";
+        success = false;
+    }
+
+    // Deviation at random points, drawn uniformly in the reduced parameters:
+    std::mt19937_64 random(42);
+    std::uniform_real_distribution<double> uniform(0., 1.);
+    std::vector<std::vector<double>> points;
+    for(size_t i = 0; i < 2000; i++) {
+        points.push_back({1e-3 * std::pow(1e3, uniform(random)), 50. + 200. * uniform(random)});
+    }
+    double deviation = 0.;
+    for(const auto& point : points) {
+        deviation = std::max(deviation, std::abs(approximation(point) - resolution(point)));
+    }
+    LOG(STATUS) << "Largest deviation at " << points.size() << " random points: " << deviation << " um";
+    if(!(deviation <= approximation.getErrorBound())) {
+        LOG(ERROR) << "Deviation exceeds the error bound";
+        success = false;
+    }
+
+    // File round trip:
+    approximation.save(path);
+    auto loaded = surrogate::load(path);
+    std::remove(path.c_str());
+    bool identical = (loaded.getDegrees() == approximation.getDegrees() &&
+                      loaded.getErrorBound() == approximation.getErrorBound() && loaded.getHash() == hash);
+    for(const auto& point : points) {
+        identical = identical && (loaded(point) == approximation(point));
+    }
+    LOG(STATUS) << "Surrogate read back from file " << (identical ? "identical" : "DIFFERENT");
+    success = success && identical;
+
+    // Stale surrogates are detected by the hash of the template:
+    auto other = build(1e-2, 150., 4.).getHash();
+    if(!loaded.matches(hash) || loaded.matches(other)) {
+        LOG(ERROR) << "Hash of the template at 2 GeV not matched or template at 4 GeV not detected as different";
+        success = false;
+    } else {
+        LOG(STATUS) << "Template at 4 GeV detected as different";
+    }
+
+    // Invalid input has to throw:
+    auto throws = [&](const std::string& name, const surrogate::function& function, std::vector<surrogateaxis> ranges) {
+        try {
+            surrogate failing(function, std::move(ranges), hash, tolerance);
+            LOG(ERROR) << name << ": no exception";
+            success = false;
+        } catch(std::exception& e) {
+            LOG(STATUS) << name << ": \"" << e.what() << "\"";
+        }
+    };
+    throws("Empty range", resolution, {{1e-3, 1., true}, {150., 150., false}});
+    throws("Logarithmic range from zero", resolution, {{0., 1., true}, {50., 250., false}});
+    throws(
+        "Failing function",
+        [&](const std::vector<double>& parameters) {
+            if(parameters[1] > 200.) {
+                throw std::runtime_error("function failure");
+            }
+            return resolution(parameters);
+        },
+        axes);
+
+    if(!success) {
+        return 1;
+    }
+    LOG(STATUS) << "Surrogate within its error bound, file round trip and hash check passed";
+    return 0;
+}
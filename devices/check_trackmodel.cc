@@ -0,0 +1,172 @@
+// Check of the closed-form track model resolutions against a Monte Carlo simulation of the tracks and their fits
+
+#include "assembly.h"
+#include "constants.h"
+#include "log.h"
+#include "materials.h"
+#include "smoother.h"
+#include "trackmodel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+
+using namespace std;
+using namespace gblsim;
+using namespace unilog;
+
+int main(int argc, char* argv[]) {
+
+    /*
+     * DATURA-like telescope with two arms of three planes and an inactive DUT of 10% X0 in between, at 2 GeV and at an
+     * energy high enough to switch off the scattering. For both cheap track models, 2*10^5 tracks are scattered and
+     * measured, the straight line fits of the model are applied to the measurements and the widths of the position and
+     * kink errors at the DUT are compared with the closed-form resolutions. They have to agree within five standard
+     * deviations of the simulated widths. Without scattering the straight line fit has to equal the GBL smoother.
+     * Returns 1 otherwise.
+     */
+
+    // Add cout as the default logging stream
+    Log::addStream(std::cout);
+    Log::setReportingLevel(LogLevel::INFO);
+
+    for(int i = 1; i < argc; i++) {
+        // Setting verbosity:
+        if(std::string(argv[i]) == "-v") {
+            try {
+                LogLevel log_level = Log::getLevelFromString(std::string(argv[++i]));
+                Log::setReportingLevel(log_level);
+            } catch(std::invalid_argument& e) {
+                LOG(ERROR) << "Invalid verbosity level \"" << std::string(argv[i]) << "\", ignoring overwrite";
+            }
+        }
+    }
+
+    // Number of simulated tracks, the relative statistical error of a simulated width is 1/sqrt(2 N):
+    const size_t tracks = 200000;
+    const double tolerance = 5. / std::sqrt(2. * static_cast<double>(tracks));
+    // Largest accepted relative difference between the straight line fit and the smoother without scattering:
+    const double smoother_tolerance = 1e-6;
+
+    // MIMOSA26 planes with the DUT as fourth plane in z:
+    double MIM26 = 55e-3 / X0_Si + 50e-3 / X0_Kapton;
+    double RES = 3.4e-3;
+    std::vector<plane> planes;
+    for(size_t i = 0; i < 3; i++) {
+        planes.push_back(plane::active(20. * static_cast<double>(i), MIM26, RES));
+    }
+    planes.push_back(plane::inactive(190., 0.1));
+    for(size_t i = 0; i < 3; i++) {
+        planes.push_back(plane::active(340. + 20. * static_cast<double>(i), MIM26, RES));
+    }
+
+    std::mt19937_64 random(42);
+    std::normal_distribution<double> normal(0., 1.);
+
+    bool success = true;
+    for(double energy : {2., 1e7}) {
+        telescope tel(planes, energy);
+        const auto& points = tel.getChain();
+        auto target = tel.getChainPoint(3);
+        auto size = points.size();
+
+        for(auto model : {trackmodel::straightline, trackmodel::triplet}) {
+            auto expected = trackestimator(model).evaluate(points, target, 0);
+            const size_t arm = (model == trackmodel::triplet ? 3 : size);
+
+            // Measurements of every fit, the closest ones on either side for the arms:
+            std::vector<size_t> upstream, downstream, all;
+            for(size_t p = 0; p < size; p++) {
+                if(!(points.getMeasurement(p, 0) > 0.)) {
+                    continue;
+                }
+                all.push_back(p);
+                if(p < target) {
+                    upstream.push_back(p);
+                } else if(p > target) {
+                    downstream.push_back(p);
+                }
+            }
+            if(upstream.size() > arm) {
+                upstream.erase(upstream.begin(), upstream.end() - static_cast<std::ptrdiff_t>(arm));
+            }
+            if(downstream.size() > arm) {
+                downstream.resize(arm);
+            }
+
+            // Weighted straight line fit of the measurements, returning position and slope at the target:
+            std::vector<double> measured(size), offset(size), kinks(size);
+            auto fit = [&](const std::vector<size_t>& used) {
+                double s0 = 0., s1 = 0., s2 = 0., b0 = 0., b1 = 0.;
+                for(const auto& p : used) {
+                    double weight = points.getMeasurement(p, 0);
+                    double z = points.getPosition(p) - points.getPosition(target);
+                    s0 += weight;
+                    s1 += weight * z;
+                    s2 += weight * z * z;
+                    b0 += weight * measured[p];
+                    b1 += weight * z * measured[p];
+                }
+                double det = s0 * s2 - s1 * s1;
+                return std::make_pair((s2 * b0 - s1 * b1) / det, (s0 * b1 - s1 * b0) / det);
+            };
+
+            double position_sum = 0., kink_sum = 0.;
+            for(size_t t = 0; t < tracks; t++) {
+                // Propagate the track through all scatterers:
+                double x = 0., slope = 0.;
+                for(size_t p = 0; p < size; p++) {
+                    if(p > 0) {
+                        x += slope * (points.getPosition(p) - points.getPosition(p - 1));
+                    }
+                    offset[p] = x;
+                    double precision = points.getScatterer(p);
+                    kinks[p] = std::isinf(precision) ? 0. : normal(random) / std::sqrt(precision);
+                    slope += kinks[p];
+                }
+                for(const auto& p : all) {
+                    measured[p] = offset[p] + normal(random) / std::sqrt(points.getMeasurement(p, 0));
+                }
+
+                auto up = fit(upstream);
+                auto down = fit(downstream);
+                double position = (model == trackmodel::triplet ? 0.5 * (up.first + down.first) : fit(all).first);
+                position_sum += (position - offset[target]) * (position - offset[target]);
+                double kink = down.second - up.second - kinks[target];
+                kink_sum += kink * kink;
+            }
+            double position = std::sqrt(position_sum / static_cast<double>(tracks)) * 1E3;
+            double kink = std::sqrt(kink_sum / static_cast<double>(tracks)) * 1E6;
+
+            double difference =
+                std::max(std::abs(position - expected.position) / position, std::abs(kink - expected.kink) / kink);
+            LOG(STATUS) << (model == trackmodel::triplet ? "Triplet" : "Straight line") << " model at " << energy
+                        << " GeV: position " << expected.position << " um, simulated " << position << " um, kink "
+                        << expected.kink << " urad, simulated " << kink << " urad";
+            if(!(difference <= tolerance)) {
+                LOG(ERROR) << "Closed form differs from the simulation by " << difference << ", more than " << tolerance;
+                success = false;
+            }
+
+            // Without scattering the straight line fit of all measurements is the optimal estimate:
+            if(energy > 1e6 && model == trackmodel::straightline) {
+                smoother reference(points, 0);
+                double optimal = std::sqrt(reference.getCovariance(target)(0, 0)) * 1E3;
+                double deviation = std::abs(expected.position - optimal) / optimal;
+                LOG(STATUS) << "Smoother without scattering: " << optimal << " um, relative difference " << deviation;
+                if(!(deviation <= smoother_tolerance)) {
+                    LOG(ERROR) << "Straight line differs from the smoother by " << deviation << ", more than "
+                               << smoother_tolerance;
+                    success = false;
+                }
+            }
+        }
+    }
+
+    if(!success) {
+        return 1;
+    }
+    LOG(STATUS) << "Track models agree with the simulation within " << tolerance;
+    return 0;
+}
@@ -58,6 +58,8 @@ int main(int argc, char* argv[]) {
 
     // Beam: 250 MeV Pi at PSI
     double BEAM = 0.250;
+    // Charged pion mass in [GeV]:
+    double MASS = 0.13957;
 
     // Loop over possible intrinsic pixel plane resolutions [um]
     for(double resolution = 5; resolution < 55; resolution++) {
@@ -82,7 +84,7 @@ int main(int argc, char* argv[]) {
         planes.push_back(pl2);
         planes.push_back(pl3);
 
-        telescope mytel(planes, BEAM);
+        telescope mytel(planes, BEAM, X0_Air, MASS);
         LOG(STATUS) << "Intrinsic: " << resolution << " Track PAD1: " << mytel.getResolution(2);
         LOG(STATUS) << "Intrinsic: " << resolution << " Track PAD2: " << mytel.getResolution(3) << endl;
         resolution_pad1->Fill(resolution, mytel.getResolution(2), 1);
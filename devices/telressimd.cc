@@ -0,0 +1,65 @@
+// Resolution daemon answering queries on a local Unix domain socket
+
+#include <csignal>
+
+#include "log.h"
+#include "server.h"
+
+using namespace std;
+using namespace gblsim;
+using namespace unilog;
+
+namespace {
+    server* instance = nullptr;
+
+    void interrupt(int) {
+        if(instance != nullptr) {
+            instance->stop();
+        }
+    }
+} // namespace
+
+int main(int argc, char* argv[]) {
+
+    /*
+     * Long-running resolution service for run control and shift tools, e.g.
+     *   echo "geometry 5 0:0.00075:0.00324 20:0.00075:0.00324 40:0.00075:0.00324 60:0.01 ..." | socat - UNIX:telressimd.sock
+     *   echo "resolution <hash> 3" | socat - UNIX:telressimd.sock
+     */
+
+    // Add cout as the default logging stream
+    Log::addStream(std::cout);
+    Log::setReportingLevel(LogLevel::WARNING);
+
+    std::string path = "telressimd.sock";
+    size_t cache = 64;
+
+    for(int i = 1; i < argc; i++) {
+        // Setting verbosity:
+        if(std::string(argv[i]) == "-v") {
+            try {
+                LogLevel log_level = Log::getLevelFromString(std::string(argv[++i]));
+                Log::setReportingLevel(log_level);
+            } catch(std::invalid_argument& e) {
+                LOG(ERROR) << "Invalid verbosity level \"" << std::string(argv[i]) << "\", ignoring overwrite";
+            }
+        }
+        // Socket path and number of cached telescopes:
+        if(std::string(argv[i]) == "-s" && i + 1 < argc) {
+            path = argv[++i];
+        }
+        if(std::string(argv[i]) == "-c" && i + 1 < argc) {
+            cache = std::stoul(std::string(argv[++i]));
+        }
+    }
+
+    server service(path, cache);
+    instance = &service;
+    std::signal(SIGINT, interrupt);
+    std::signal(SIGTERM, interrupt);
+
+    LOG(STATUS) << "Serving resolution queries on " << path;
+    service.run();
+    instance = nullptr;
+    return 0;
+}
@@ -5,11 +5,17 @@
 #include <TProfile.h>
 #include <TString.h>
 
+#include "alignment.h"
 #include "assembly.h"
+#include "checkpoint.h"
 #include "constants.h"
+#include "hash.h"
 #include "log.h"
 #include "materials.h"
+#include "profiler.h"
 #include "propagate.h"
+#include "scanfile.h"
+#include "tolerance.h"
 
 using namespace std;
 using namespace gblsim;
@@ -27,6 +33,13 @@ int main(int argc, char* argv[]) {
     Log::addStream(std::cout);
     Log::setReportingLevel(LogLevel::INFO);
 
+    // Number of perturbed telescopes per scan point for the uncertainty band, disabled by default:
+    size_t samples = 0;
+    // Resume an interrupted scan from its checkpoint, otherwise the scan starts from scratch:
+    bool resume = false;
+    // Forecast the tracks needed for the alignment of the telescope planes:
+    bool forecast_alignment = false;
+
     for(int i = 1; i < argc; i++) {
         // Setting verbosity:
         if(std::string(argv[i]) == "-v") {
@@ -37,6 +50,22 @@ int main(int argc, char* argv[]) {
                 LOG(ERROR) << "Invalid verbosity level \"" << std::string(argv[i]) << "\", ignoring overwrite";
             }
         }
+        // Per-phase profiling, summary written at exit:
+        if(std::string(argv[i]) == "-p") {
+            profiler::enable();
+        }
+        // Resume from the checkpoint of an interrupted run:
+        if(std::string(argv[i]) == "-r") {
+            resume = true;
+        }
+        // Alignment forecast for the bare telescope:
+        if(std::string(argv[i]) == "-a") {
+            forecast_alignment = true;
+        }
+        // Uncertainty band from sampled input tolerances:
+        if(std::string(argv[i]) == "-u" && i + 1 < argc) {
+            samples = std::stoul(std::string(argv[++i]));
+        }
     }
 
     TFile* out = TFile::Open("datura-resolution.root", "RECREATE");
@@ -44,6 +73,15 @@ int main(int argc, char* argv[]) {
 
     auto* c1 = new TCanvas("c1", "resolution", 700, 700);
     auto* resolution = new TProfile("resolution", " ", 100, 0, 0.02);
+    auto* resolution_low = new TProfile("resolution_low", " ", 100, 0, 0.02);
+    auto* resolution_high = new TProfile("resolution_high", " ", 100, 0, 0.02);
+
+    // Columnar output, available while the scan is running:
+    std::vector<std::string> columns = {"dut_x0", "resolution"};
+    if(samples > 0) {
+        columns.insert(columns.end(), {"resolution_q16", "resolution_q50", "resolution_q84"});
+    }
+    scanwriter scan("datura-resolution.scan", columns);
 
     //----------------------------------------------------------------------------
     // Preparation of the telescope and beam properties:
@@ -67,6 +105,13 @@ int main(int argc, char* argv[]) {
     // Beam energy 5 GeV electrons/positrons at DESY:
     double BEAM = 5.0;
 
+    // Tolerances of plane positions [mm], material budgets and resolutions (relative), and of the beam energy (relative):
+    tolerance TOL = {0.5, 0.1, 0.05};
+    double BEAM_TOL = 0.05;
+    uncertainty band(samples);
+    band.setTolerance(TOL);
+    band.setBeamTolerance(BEAM_TOL);
+
     //----------------------------------------------------------------------------
     // Build the trajectory through the telescope device:
 
@@ -87,22 +132,72 @@ int main(int argc, char* argv[]) {
         position += DIST;
     }
 
-    for(double dut_x0 = 0.001; dut_x0 < 0.05; dut_x0 += 0.0001) {
+    // Scan of the DUT material budget:
+    double SCAN_MIN = 0.001;
+    double SCAN_STEP = 0.0001;
+    uint64_t SCAN_POINTS = 490;
+
+    // Version of the scan, to be increased whenever its physics or results change so old checkpoints are not replayed:
+    uint64_t SCAN_VERSION = 1;
+
+    // Resume from the checkpoint of a previous, interrupted run with identical configuration if requested:
+    hasher configuration;
+    configuration.add(SCAN_VERSION).add(MIM26).add(RES).add(DIST).add(DUT_DIST).add(BEAM);
+    configuration.add(SCAN_MIN).add(SCAN_STEP).add(SCAN_POINTS);
+    configuration.add(samples).add(TOL.position).add(TOL.material).add(TOL.resolution).add(BEAM_TOL);
+    if(!resume) {
+        std::remove("datura-resolution.ckpt");
+    }
+    checkpoint progress("datura-resolution.ckpt", configuration.value());
+    if(progress.size() > 0) {
+        LOG(INFO) << "Resuming scan, " << progress.size() << " of " << SCAN_POINTS << " points already done";
+    }
+
+    for(uint64_t step = 0; step < SCAN_POINTS; step++) {
+        double dut_x0 = SCAN_MIN + static_cast<double>(step) * SCAN_STEP;
 
-        // Prepare the DUT (no measurement, just scatterer
-        plane dut(2 * DIST + DUT_DIST, dut_x0, false);
+        std::vector<double> results;
+        if(progress.isDone(step)) {
+            results = progress.getResults(step);
+        } else {
+            // Prepare the DUT (no measurement, just scatterer
+            plane dut(2 * DIST + DUT_DIST, dut_x0, false);
 
-        // Duplicate the planes vector and add the current DUT:
-        std::vector<plane> planes = datura;
-        planes.push_back(dut);
+            // Duplicate the planes vector and add the current DUT:
+            std::vector<plane> planes = datura;
+            planes.push_back(dut);
 
-        // Build the telescope:
-        telescope mytel(planes, BEAM);
+            // Build the telescope:
+            telescope mytel(planes, BEAM);
 
-        // Get the resolution at plane-vector position (x):
-        LOG(STATUS) << "Track resolution at DUT with " << dut_x0 << "% X0: " << mytel.getResolution(3);
-        resolution->Fill(dut_x0, mytel.getResolution(3), 1);
+            // Get the resolution at plane-vector position (x):
+            results.push_back(mytel.getResolution(3));
+
+            // Quantiles of the resolution for the sampled input tolerances:
+            if(samples > 0) {
+                for(const auto& quantile : band.getQuantiles(mytel, 3, {0.16, 0.5, 0.84})) {
+                    results.push_back(quantile.first);
+                }
+            }
+            progress.record(step, results);
+        }
+
+        double dut_resolution = results.at(0);
+        LOG(STATUS) << "Track resolution at DUT with " << dut_x0 << "% X0: " << dut_resolution;
+        resolution->Fill(dut_x0, dut_resolution, 1);
+        if(samples > 0) {
+            LOG(STATUS) << "  68% band: " << results.at(1) << " - " << results.at(3);
+            resolution_low->Fill(dut_x0, results.at(1), 1);
+            resolution_high->Fill(dut_x0, results.at(3), 1);
+        }
+
+        std::vector<double> row = {dut_x0};
+        row.insert(row.end(), results.begin(), results.end());
+        PROFILE(output);
+        scan.fill(row);
     }
+    // The scan is complete, a later run must not replay it:
+    progress.remove();
 
     c1->cd();
     resolution->SetTitle("DATURA Track Resolution at DUT;DUT material budget x/X_{0};resolution at DUT #left[#mum#right]");
@@ -113,9 +208,28 @@ int main(int argc, char* argv[]) {
     resolution->SetMarkerColor(kRed + 1);
 
     resolution->Draw();
+    if(samples > 0) {
+        for(auto* quantile : {resolution_low, resolution_high}) {
+            quantile->SetMarkerStyle(0);
+            quantile->SetLineColor(kRed + 1);
+            quantile->SetLineStyle(2);
+            quantile->Draw("same");
+        }
+    }
     c1->Write();
 
+    // Tracks needed to align the telescope planes, with the outermost planes fixed and a 3mm wide beam spot:
+    if(forecast_alignment) {
+        telescope bare(datura, BEAM);
+        alignment forecast(bare, {{0., 0.}, {3., 3.}, {0., 0.}});
+        for(const auto& tracks : forecast.getTracks(1., 0.1)) {
+            LOG(STATUS) << "Alignment of plane " << tracks.first << " to 1um and 0.1mrad requires " << tracks.second
+                        << " tracks";
+        }
+    }
+
     // Write result to file
+    PROFILE(output);
     out->Write();
     return 0;
 }
@@ -49,6 +49,12 @@ int main(int argc, char* argv[]) {
     auto* c2 = new TCanvas("c2", "kink_resolution", 700, 700);
     auto* kink_resolution = new TProfile("kink_resolution", " ", 16, 0, 160);
 
+    auto* c3 = new TCanvas("c3", "placement", 700, 700);
+    auto* placement_resolution = new TProfile("placement_resolution", " ", 1000, 300., 400.);
+
+    auto* c4 = new TCanvas("c4", "placement_kink", 700, 700);
+    auto* placement_kink_resolution = new TProfile("placement_kink_resolution", " ", 1000, 300., 400.);
+
     //----------------------------------------------------------------------------
     // Preparation of the telescope and beam properties:
 
@@ -120,6 +126,27 @@ int main(int argc, char* argv[]) {
         position = 0;
     }
 
+    // Scan the target position between the arms for the downstream spacing of 20mm in a single pass:
+    for(int i = 0; i < 3; i++) {
+        datura.emplace_back(position, MIM26, true, RES);
+        position += DIST_up;
+    }
+    position = 2 * DIST_up + DUT_DIST_up + DUT_DIST_down;
+    for(int i = 0; i < 3; i++) {
+        datura.emplace_back(position, MIM26, true, RES);
+        position += 20.;
+    }
+    telescope arms(datura, BEAM);
+
+    std::vector<double> candidates;
+    for(double z = 2 * DIST_up + 5.; z <= 2 * DIST_up + DUT_DIST_up + DUT_DIST_down - 5.; z += 0.1) {
+        candidates.push_back(z);
+    }
+    for(const auto& target : arms.getTargetScan(candidates, {10.})) {
+        placement_resolution->Fill(target.position, target.resolution.first, 1);
+        placement_kink_resolution->Fill(target.position, target.kink.first, 1);
+    }
+
     c1->cd();
     resolution->SetTitle("DATURA Track Resolution at DUT;DUT material budget x/X_{0};resolution at DUT #left[#mum#right]");
     resolution->SetMarkerStyle(0);
@@ -141,6 +168,23 @@ int main(int argc, char* argv[]) {
     kink_resolution->Draw();
     c2->Write();
 
+    c3->cd();
+    placement_resolution->SetTitle("Track Resolution at Target;target position [mm];resolution at target #left[#mum#right]");
+    placement_resolution->SetMarkerStyle(0);
+    placement_resolution->SetLineColor(kRed + 1);
+    placement_resolution->SetLineWidth(2);
+    placement_resolution->Draw();
+    c3->Write();
+
+    c4->cd();
+    placement_kink_resolution->SetTitle(
+        "Kink Resolution at Target;target position [mm];kink resolution at target #left[#murad#right]");
+    placement_kink_resolution->SetMarkerStyle(0);
+    placement_kink_resolution->SetLineColor(kRed + 1);
+    placement_kink_resolution->SetLineWidth(2);
+    placement_kink_resolution->Draw();
+    c4->Write();
+
     // Write result to file
     out->Write();
     return 0;
@@ -48,6 +48,8 @@ int main(int argc, char* argv[]) {
 
     // Beam: 250 MeV Pi at PSI
     double BEAM = 0.250;
+    // Charged pion mass in [GeV]:
+    double MASS = 0.13957;
 
     //----------------------------------------------------------------------------
     // Build the trajectory through the telescope device:
@@ -72,7 +74,7 @@ int main(int argc, char* argv[]) {
     planes.push_back(pl2);
     planes.push_back(pl3);
 
-    telescope mytel(planes, BEAM);
+    telescope mytel(planes, BEAM, X0_Air, MASS);
     LOG(STATUS) << "Track resolution at Diamond 1: " << mytel.getResolution(2);
     LOG(STATUS) << "Track resolution at Diamond 2: " << mytel.getResolution(3);
 
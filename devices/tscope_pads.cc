@@ -2,6 +2,7 @@
 
 #include "assembly.h"
 #include "constants.h"
+#include "layout.h"
 #include "log.h"
 #include "materials.h"
 #include "propagate.h"
@@ -25,6 +26,7 @@ int main(int argc, char* argv[]) {
     Log::addStream(std::cout);
     Log::setReportingLevel(LogLevel::INFO);
 
+    bool search_layouts = false;
     for(int i = 1; i < argc; i++) {
         // Setting verbosity:
         if(std::string(argv[i]) == "-v") {
@@ -35,6 +37,10 @@ int main(int argc, char* argv[]) {
                 LOG(ERROR) << "Invalid verbosity level \"" << std::string(argv[i]) << "\", ignoring overwrite";
             }
         }
+        // Search the best layouts around PAD1:
+        if(std::string(argv[i]) == "-l") {
+            search_layouts = true;
+        }
     }
 
     //----------------------------------------------------------------------------
@@ -46,6 +52,8 @@ int main(int argc, char* argv[]) {
 
     // Beam: 250 MeV Pi at PSI
     double BEAM = 0.250;
+    // Charged pion mass in [GeV]:
+    double MASS = 0.13957;
 
     //----------------------------------------------------------------------------
     // Build the trajectory through the telescope device:
@@ -68,10 +76,15 @@ int main(int argc, char* argv[]) {
     planes.push_back(pl2);
     planes.push_back(pl3);
 
-    telescope mytel(planes, BEAM);
+    telescope mytel(planes, BEAM, X0_Air, MASS);
     LOG(STATUS) << "Track resolution (X) at PAD1: " << mytel.getResolution(2);
     LOG(STATUS) << "Track resolution (X) at PAD2: " << mytel.getResolution(3);
 
+    // Correlation of the predicted track positions at both pads:
+    auto joint = mytel.getJointCovariance({2, 3});
+    LOG(STATUS) << "Track position correlation (X) between PAD1 and PAD2: "
+                << joint.first(0, 2) / sqrt(joint.first(0, 0) * joint.first(2, 2));
+
     //----------------------------------------------------------------------------
     // Build the trajectory through the telescope device:
 
@@ -92,7 +105,7 @@ int main(int argc, char* argv[]) {
     yplanes.push_back(ypl2);
     yplanes.push_back(ypl3);
 
-    telescope ymytel(yplanes, BEAM);
+    telescope ymytel(yplanes, BEAM, X0_Air, MASS);
     LOG(STATUS) << "Track resolution (Y) at PAD1: " << ymytel.getResolution(2);
     LOG(STATUS) << "Track resolution (Y) at PAD2: " << ymytel.getResolution(3);
 
@@ -106,7 +119,7 @@ int main(int argc, char* argv[]) {
     aplanes.push_back(pad1);
     aplanes.push_back(pad2);
 
-    telescope amytel(aplanes, BEAM);
+    telescope amytel(aplanes, BEAM, X0_Air, MASS);
     LOG(STATUS) << "Track resolution (X) at PAD1: " << amytel.getResolution(2);
     LOG(STATUS) << "Track resolution (X) at PAD2: " << amytel.getResolution(3);
 
@@ -119,9 +132,31 @@ int main(int argc, char* argv[]) {
     yaplanes.push_back(ypad1);
     yaplanes.push_back(ypad2);
 
-    telescope yamytel(yaplanes, BEAM);
+    telescope yamytel(yaplanes, BEAM, X0_Air, MASS);
     LOG(STATUS) << "Track resolution (Y) at PAD1: " << yamytel.getResolution(2);
     LOG(STATUS) << "Track resolution (Y) at PAD2: " << yamytel.getResolution(3);
 
+    //----------------------------------------------------------------------------
+    // Search for the best layouts of analog planes and MIMOSA26 planes around PAD1 for a given cost:
+    if(!search_layouts) {
+        return 0;
+    }
+    LOG(STATUS) << "Layout search:";
+
+    double MIM26 = 55e-3 / X0_Si + 50e-3 / X0_Kapton;
+    std::vector<sensortype> catalog = {{"analog", analog_plane, {resolution_analog, resolution_analog}, 1.},
+                                       {"MIMOSA26", MIM26, {3.24e-3, 3.24e-3}, 5.}};
+    std::vector<double> slots = {-20.32, 0, 20.32, 81.28, 101.6, 121.92};
+
+    layoutsearch search(catalog, slots, pad1, BEAM, X0_Air, MASS);
+    for(const auto& candidate : search.getParetoFront()) {
+        std::string sensors;
+        for(const auto& type : candidate.sensors) {
+            sensors += (type < catalog.size() ? catalog.at(type).name : "-") + " ";
+        }
+        LOG(STATUS) << "Cost " << candidate.cost << ", track resolution (X) at PAD1: " << candidate.resolution << " with "
+                    << sensors;
+    }
+
     return 0;
 }
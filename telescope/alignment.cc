@@ -0,0 +1,182 @@
+#include "alignment.h"
+
+#include "cholesky.h"
+#include "log.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace gblsim;
+using namespace unilog;
+
+alignment::alignment(const telescope& tel, const beamspot& beam, const std::vector<size_t>& fixed)
+    : m_beam(beam), m_size(0), m_weight(0) {
+
+    const auto& points = tel.getChain();
+    auto measured = [&](size_t pl, size_t axis) { return points.getMeasurement(tel.getChainPoint(pl), axis) > 0.; };
+
+    for(size_t pl = 0; pl < tel.getNumberOfPlanes(); pl++) {
+        if(measured(pl, 0) || measured(pl, 1)) {
+            m_measurements.push_back(pl);
+        }
+    }
+    if(m_measurements.size() < 3) {
+        LOG(WARNING) << "Only " << m_measurements.size() << " measurement planes, alignment is not constrained";
+    }
+
+    // Only measurement planes carry alignment parameters which can be fixed:
+    std::vector<size_t> reference;
+    for(const auto& pl : fixed) {
+        if(std::find(m_measurements.begin(), m_measurements.end(), pl) == m_measurements.end()) {
+            LOG(WARNING) << "Plane " << pl << " has no measurement, ignoring it as fixed plane";
+        } else if(std::find(reference.begin(), reference.end(), pl) == reference.end()) {
+            reference.push_back(pl);
+        }
+    }
+    if(fixed.empty() && !m_measurements.empty()) {
+        reference = {m_measurements.front(), m_measurements.back()};
+    }
+
+    m_parameters.assign(tel.getNumberOfPlanes(), {-1, -1, -1});
+    size_t aligned = 0;
+    for(const auto& pl : m_measurements) {
+        if(std::find(reference.begin(), reference.end(), pl) != reference.end()) {
+            continue;
+        }
+        aligned++;
+        for(size_t axis = 0; axis < 2; axis++) {
+            if(measured(pl, axis)) {
+                m_parameters[pl][axis] = m_size++;
+            }
+        }
+        m_parameters[pl][2] = m_size++;
+    }
+    LOG(DEBUG) << "Aligning " << m_size << " parameters of " << aligned << " planes";
+
+    m_normal = Eigen::MatrixXd::Zero(m_size, m_size);
+    addTracks(tel);
+}
+
+Eigen::MatrixXd alignment::getNormalMatrix(const telescope& tel) const {
+
+    const auto& points = tel.getChain();
+    auto planes = m_measurements.size();
+
+    std::vector<double> position(planes);
+    for(size_t i = 0; i < planes; i++) {
+        position[i] = points.getPosition(tel.getChainPoint(m_measurements[i]));
+    }
+
+    // Moments of the track position along one dimension at two planes, from the beam spot:
+    auto mean = [&](size_t axis) { return axis == 0 ? m_beam.center.first : m_beam.center.second; };
+    auto moment = [&](size_t axis, size_t i, size_t j) {
+        double center = mean(axis);
+        double width = (axis == 0 ? m_beam.width.first : m_beam.width.second);
+        double divergence = (axis == 0 ? m_beam.divergence.first : m_beam.divergence.second);
+        return center * center + width * width + divergence * divergence * position[i] * position[j];
+    };
+
+    Eigen::MatrixXd normal = Eigen::MatrixXd::Zero(m_size, m_size);
+    auto cov = tel.getJointCovariance(m_measurements);
+
+    for(size_t axis = 0; axis < 2; axis++) {
+        const auto& joint = (axis == 0 ? cov.first : cov.second);
+        auto other = 1 - axis;
+
+        // Information on the measurement offsets with the track marginalized, R = W - W C W:
+        Eigen::VectorXd weight(planes);
+        for(size_t i = 0; i < planes; i++) {
+            weight[static_cast<Eigen::Index>(i)] = points.getMeasurement(tel.getChainPoint(m_measurements[i]), axis);
+        }
+        Eigen::MatrixXd information(planes, planes);
+        for(size_t i = 0; i < planes; i++) {
+            for(size_t j = 0; j < planes; j++) {
+                auto ri = static_cast<Eigen::Index>(i);
+                auto rj = static_cast<Eigen::Index>(j);
+                information(ri, rj) = -weight[ri] * joint(2 * ri, 2 * rj) * weight[rj];
+            }
+        }
+        information.diagonal() += weight;
+
+        // A shift moves the hit along its dimension, a rotation about z by the position along the other dimension with
+        // opposite signs for x and y:
+        double sign = (axis == 0 ? -1. : 1.);
+        for(size_t i = 0; i < planes; i++) {
+            const auto& pi = m_parameters[m_measurements[i]];
+            for(size_t j = 0; j < planes; j++) {
+                const auto& pj = m_parameters[m_measurements[j]];
+                double r = information(static_cast<Eigen::Index>(i), static_cast<Eigen::Index>(j));
+                if(pi[axis] >= 0 && pj[axis] >= 0) {
+                    normal(pi[axis], pj[axis]) += r;
+                }
+                if(pi[axis] >= 0 && pj[2] >= 0) {
+                    normal(pi[axis], pj[2]) += r * sign * mean(other);
+                }
+                if(pi[2] >= 0 && pj[axis] >= 0) {
+                    normal(pi[2], pj[axis]) += r * sign * mean(other);
+                }
+                if(pi[2] >= 0 && pj[2] >= 0) {
+                    normal(pi[2], pj[2]) += r * moment(other, i, j);
+                }
+            }
+        }
+    }
+    return normal;
+}
+
+void alignment::addTracks(const telescope& tel, double weight) {
+    if(tel.getNumberOfPlanes() != m_parameters.size()) {
+        LOG(ERROR) << "Telescope with " << tel.getNumberOfPlanes() << " planes does not match the alignment of "
+                   << m_parameters.size() << " planes, ignoring it";
+        return;
+    }
+
+    // Running weighted mean of the normal matrix per track:
+    m_weight += weight;
+    m_normal += weight / m_weight * (getNormalMatrix(tel) - m_normal);
+
+    cholesky decomposition(m_normal);
+    if(!decomposition.isPositiveDefinite(1e-12)) {
+        LOG(WARNING) << "Alignment parameters are not constrained by tracks, more planes need to be fixed";
+        m_covariance = Eigen::MatrixXd::Constant(m_size, m_size, std::numeric_limits<double>::infinity());
+        return;
+    }
+    m_covariance = decomposition.getInverse();
+}
+
+Eigen::MatrixXd alignment::getCovariance(double tracks) const {
+    return m_covariance / tracks;
+}
+
+std::vector<alignmentprecision> alignment::getPrecision(double tracks) const {
+    std::vector<alignmentprecision> precision;
+    auto sigma = [&](Eigen::Index index, double scale) {
+        return index >= 0 ? std::sqrt(m_covariance(index, index) / tracks) * scale
+                          : std::numeric_limits<double>::infinity();
+    };
+    for(size_t pl = 0; pl < m_parameters.size(); pl++) {
+        const auto& parameters = m_parameters[pl];
+        if(parameters[2] < 0) {
+            continue;
+        }
+        precision.push_back(
+            {pl, {sigma(parameters[0], 1E3), sigma(parameters[1], 1E3)}, sigma(parameters[2], 1E3)});
+    }
+    return precision;
+}
+
+std::vector<std::pair<size_t, double>> alignment::getTracks(double shift, double rotation) const {
+    // The variances scale with 1/N, so the required tracks follow from the precision of one track:
+    std::vector<std::pair<size_t, double>> tracks;
+    for(const auto& single : getPrecision(1.)) {
+        double required = std::pow(single.rotation / rotation, 2);
+        for(const auto& sigma : {single.shift.first, single.shift.second}) {
+            if(std::isfinite(sigma)) {
+                required = std::max(required, std::pow(sigma / shift, 2));
+            }
+        }
+        tracks.emplace_back(single.plane, required);
+    }
+    return tracks;
+}
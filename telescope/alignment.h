@@ -0,0 +1,81 @@
+#ifndef ALIGNMENT_H
+#define ALIGNMENT_H
+
+#include <array>
+#include <utility>
+#include <vector>
+
+#include <Eigen/Core>
+
+#include "assembly.h"
+
+namespace gblsim {
+
+    // Gaussian beam spot at z = 0, separable in both dimensions
+    struct beamspot {
+        // Center and width of the spot in [mm]
+        std::pair<double, double> center;
+        std::pair<double, double> width;
+        // Angular spread of the beam in [rad]
+        std::pair<double, double> divergence;
+    };
+
+    // Predicted alignment precision of one plane
+    struct alignmentprecision {
+        // Index of the plane
+        size_t plane;
+        // Precision of the shifts along both dimensions in [um] and of the rotation about the beam axis in [mrad]
+        std::pair<double, double> shift;
+        double rotation;
+    };
+
+    // Forecast of the alignment precision of the measurement planes of a telescope.
+    // Every measurement plane gets global derivatives for its shifts and its rotation about the beam axis. Marginalizing
+    // the track parameters, the information of one track on the measurement offsets of one dimension is W - W C W, with W
+    // the measurement precisions and C the joint covariance of the fitted positions at the measurement planes. Projected
+    // onto the alignment parameters and averaged over the beam spot this gives the expected normal matrix per track, which
+    // Millepede would accumulate from the same derivatives. The covariance after N tracks is its inverse divided by N.
+    // Shifts, shears and rotations of the whole telescope are not constrained by tracks, so some planes must be fixed.
+    // Without enough fixed planes the covariance is infinite.
+    class alignment {
+    public:
+        // Forecast for tracks through the given telescope and beam spot, with the given planes fixed. By default the first
+        // and the last measurement planes are fixed. Planes without measurement have nothing to align and are ignored
+        // with a warning
+        alignment(const telescope& tel, const beamspot& beam, const std::vector<size_t>& fixed = {});
+
+        // Add tracks through another telescope with identical planes with the given relative weight, e.g. to sample the
+        // beam energy spectrum
+        void addTracks(const telescope& tel, double weight = 1.);
+
+        // Return the expected normal matrix of one track and the covariance of the alignment parameters after the given
+        // number of tracks, in [mm] and [rad]. Parameters are ordered by plane as (shift x, shift y, rotation), shifts
+        // only for the measured dimensions
+        const Eigen::MatrixXd& getNormalMatrix() const { return m_normal; }
+        Eigen::MatrixXd getCovariance(double tracks) const;
+
+        // Return the alignment precision of every plane which is not fixed after the given number of tracks
+        std::vector<alignmentprecision> getPrecision(double tracks) const;
+        // Return the number of tracks required for every plane which is not fixed to reach the given precision of the
+        // shifts in [um] and of the rotation in [mrad]
+        std::vector<std::pair<size_t, double>> getTracks(double shift, double rotation) const;
+
+    private:
+        // Return the normal matrix of one track through the given telescope
+        Eigen::MatrixXd getNormalMatrix(const telescope& tel) const;
+
+        beamspot m_beam;
+        // Index of the alignment parameters (shift x, shift y, rotation) of every plane, -1 if not aligned:
+        std::vector<std::array<Eigen::Index, 3>> m_parameters;
+        std::vector<size_t> m_measurements;
+        Eigen::Index m_size;
+
+        double m_weight;
+        Eigen::MatrixXd m_normal;
+        // Covariance for one track:
+        Eigen::MatrixXd m_covariance;
+    };
+
+} // namespace gblsim
+
+#endif /* ALIGNMENT_H */
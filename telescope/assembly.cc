@@ -3,32 +3,43 @@
 
 #include "assembly.h"
 
+#include "cholesky.h"
 #include "constants.h"
+#include "energyloss.h"
+#include "hash.h"
 #include "log.h"
 #include "materials.h"
+#include "profiler.h"
 #include "propagate.h"
 
 #include <algorithm>
+#include <array>
 #include <cmath>
+#include <functional>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+
+#include <Eigen/LU>
 
 using namespace gblsim;
 using namespace unilog;
 using namespace gbl;
 
 plane plane::reference(double position) {
-    return plane(position, false, 0.0, false, {0.0, 0.0}, 0.0);
+    return plane(position, false, 0.0, false, {0.0, 0.0}, -1.);
 }
 
 plane plane::inactive(double position, double material) {
-    return plane(position, true, material, false, {0.0, 0.0}, 0.0);
+    return plane(position, true, material, false, {0.0, 0.0}, -1.);
 }
 
 plane plane::active(double position, double material, double resolution) {
-    return plane(position, true, material, true, {resolution, resolution}, 0.0);
+    return plane(position, true, material, true, {resolution, resolution}, -1.);
 }
 
 plane plane::active(double position, double material, std::pair<double, double> resolution) {
-    return plane(position, true, material, true, resolution, 0.0);
+    return plane(position, true, material, true, resolution, -1.);
 }
 
 plane plane::unknown(double position, double size) {
@@ -42,7 +53,7 @@ plane::plane(double position,
              std::pair<double, double> resolution,
              double size)
     : m_measurement(has_measurement), m_resolution(2), m_scatterer(has_scatterer), m_materialbudget(material),
-      m_position(position), m_size(size) {
+      m_position(position), m_size(size), m_medium(&media::silicon) {
     m_resolution[0] = std::get<0>(resolution);
     m_resolution[1] = std::get<1>(resolution);
 }
@@ -51,175 +62,396 @@ plane::plane(double position, double material, bool has_measurement, double reso
     : plane(position, true, material, has_measurement, std::make_pair(resolution, resolution), size) {}
 
 plane::plane(double position, bool, bool, double size)
-    : m_measurement(false), m_resolution(2), m_scatterer(false), m_position(position), m_size(size) {
+    : m_measurement(false), m_resolution(2), m_scatterer(false), m_position(position), m_size(size),
+      m_medium(&media::silicon) {
     m_resolution[0] = 0.0;
     m_resolution[1] = 0.0;
 }
 
-plane::plane() : plane(0, false, 0, false, std::make_pair(0.0, 0.0), 0.0) {}
+plane::plane() : plane(0, false, 0, false, std::make_pair(0.0, 0.0), -1.) {}
+
+double plane::getMaterial() const {
+    // Path length through the plane with normal (-tan a, -tan b, 1):
+    return m_materialbudget * std::sqrt(1. + std::pow(std::tan(m_tilt.first), 2) + std::pow(std::tan(m_tilt.second), 2));
+}
+
+std::pair<double, double> plane::getProjection() const {
+    return {1. / std::cos(m_tilt.first), 1. / std::cos(m_tilt.second)};
+}
 
-telescope::telescope(std::vector<gblsim::plane> planes, double beam_energy, double material)
-    : m_volumeMaterial(material), m_parameter(5) {
+std::pair<double, double> plane::getProjectedResolution() const {
+    auto projection = getProjection();
+    return {m_resolution[0] / projection.first, m_resolution[1] / projection.second};
+}
+
+telescope::telescope(std::vector<gblsim::plane> planes, double beam_energy, double material, double mass)
+    : telescope(std::move(planes),
+                beam_energy,
+                std::vector<volume>{{-std::numeric_limits<double>::infinity(),
+                                     std::numeric_limits<double>::infinity(),
+                                     material}},
+                mass) {}
+
+telescope::telescope(std::vector<gblsim::plane> planes, double beam_energy, std::vector<volume> volumes, double mass)
+    : m_volumes(std::move(volumes)), m_beamEnergy(beam_energy), m_mass(mass), m_parameter(5) {
     LOG(INFO) << "Received " << planes.size() << " planes.";
+    checkVolumes(m_volumes, m_mass);
 
     // Make sure they are ordered in z by sorting the planes vector:
-    std::sort(planes.begin(), planes.end());
+    {
+        PROFILE(sorting);
+        std::sort(planes.begin(), planes.end());
+        m_planes = planes;
+    }
 
     double arclength = 0;
     double oldpos = 0;
     double arcDUT = -1.;
+    double sizeDUT = 0.;
 
     // Calculate the total material budget to correctly estimate the scattering:
     double total_materialbudget = getTotalMaterialBudget(planes);
+    m_totalMaterial = total_materialbudget;
+
+    PROFILE(points);
+
+    // Points of the chain, sorted in z once complete since the kinks of an unknown scatterer may overlap other points:
+    struct chainpoint {
+        double position;
+        double scatterer;
+        std::pair<double, double> measurement;
+        size_t plane;
+        double material;
+        double momentum;
+    };
+    std::vector<chainpoint> chainpoints;
+    auto measurement = [](const plane& p) {
+        auto res = p.getProjectedResolution();
+        return p.m_measurement ? std::make_pair(1. / res.first / res.first, 1. / res.second / res.second)
+                               : std::make_pair(0., 0.);
+    };
+    auto no_plane = planes.size();
+
+    // Momentum of the particle, reduced by the mean energy loss in every scatterer for particles with mass. The scattering
+    // width is evaluated with p*beta at the center of the scatterer, which is stored with the point of the chain:
+    double momentum = beam_energy;
+    double velocity = beam_energy;
+    auto scatter = [&](double radlength, const medium* matter) {
+        if(m_mass > 0.) {
+            const auto& table = energyloss::get(matter != nullptr ? *matter : media::air);
+            double center = table.getMomentum(momentum, m_mass, 0.5 * radlength);
+            momentum = table.getMomentum(center, m_mass, 0.5 * radlength);
+            velocity = center * center / std::sqrt(center * center + m_mass * m_mass);
+            // A stopped particle would leave a free kink behind, which the telescope cannot describe:
+            if(momentum <= 0.) {
+                LOG(ERROR) << "Particle stopped in scatterer with x/X0 = " << radlength;
+                throw std::runtime_error("particle ranges out in the telescope");
+            }
+        }
+        return getScatterer(velocity, radlength, total_materialbudget);
+    };
+
+    // Points of the trajectory are stored field by field and only materialized as GblPoint when the fit is run:
+    auto add_point = [this](double step, const Eigen::Vector2d& scatterer, const plane* measured) {
+        m_listOfSteps.push_back(step);
+        m_listOfScatterers.push_back(scatterer[0]);
+        m_listOfResolutions.push_back(measured != nullptr
+                                          ? std::make_pair(measured->m_resolution[0], measured->m_resolution[1])
+                                          : std::make_pair(0., 0.));
+        m_listOfProjections.push_back(measured != nullptr ? measured->getProjection() : std::make_pair(1., 1.));
+        m_listOfLevers.emplace_back(0., 0.);
+        m_listOfLocals.push_back(false);
+    };
 
     // Add first plane:
     auto pl = planes.begin();
+    auto first_scatterer = scatter(pl->getMaterial(), pl->m_medium);
     if(pl->m_measurement) {
-        m_listOfPoints.push_back(getPoint(
-            pl->m_position, pl->m_resolution, getScatterer(beam_energy, pl->m_materialbudget, total_materialbudget)));
+        add_point(pl->m_position, first_scatterer, &*pl);
         LOG(DEBUG) << "Added plane at " << arclength << " (scatterer + measurement)";
     } else {
-        m_listOfPoints.push_back(
-            getPoint(pl->m_position, getScatterer(beam_energy, pl->m_materialbudget, total_materialbudget)));
+        add_point(pl->m_position, first_scatterer, nullptr);
         LOG(DEBUG) << "Added plane at " << arclength << " (scatterer)";
     }
+    m_listOfPositions.push_back(pl->m_position);
+    chainpoints.push_back(
+        {pl->m_position, first_scatterer[0], measurement(*pl), 0, pl->getMaterial(), velocity});
     oldpos = pl->m_position;
     // Advance the iterator:
     pl++;
 
     // Store plane label:
-    m_listOfLabels.push_back(m_listOfPoints.size());
+    m_listOfLabels.push_back(m_listOfSteps.size());
 
     // All planes except first:
     for(; pl != planes.end(); pl++) {
+        auto plane_index = static_cast<size_t>(std::distance(planes.begin(), pl));
 
-        // Let's first add the air:
+        // Let's first add the volume material in the gap:
         double plane_distance = pl->m_position - oldpos;
         LOG(TRACE) << "Distance to next plane: " << plane_distance;
         double distance = 0;
-        double size;
 
-        // Check if a volume scatterer with radiation length != 0 has been defined:
-        if(m_volumeMaterial > 0.0) {
-            // Propagate [mm] from 0 to 0.21 = 0.5 - 1/sqrt(12)
-            distance = 0.21 * plane_distance;
-            arclength += distance;
+        for(const auto& volume_scatterer : getVolumeScatterers(m_volumes, oldpos, pl->m_position)) {
+            distance = volume_scatterer.position - m_listOfPositions.back();
+            arclength = volume_scatterer.position - planes.front().m_position;
 
-            // Add volume scatterer:
-            m_listOfPoints.push_back(getPoint(
-                distance, getScatterer(beam_energy, 0.5 * plane_distance / m_volumeMaterial, total_materialbudget)));
+            auto kink = scatter(volume_scatterer.material, volume_scatterer.matter);
+            add_point(distance, kink, nullptr);
+            m_listOfPositions.push_back(volume_scatterer.position);
+            chainpoints.push_back(
+                {volume_scatterer.position, kink[0], {0., 0.}, no_plane, volume_scatterer.material, velocity});
             LOG(TRACE) << "Added volume scat at " << arclength;
-
-            // Propagate [mm] 0.58 = from 0.21 to 0.79 = 0.5 + 1/sqrt(12)
-            distance = 0.58 * plane_distance;
-            arclength += distance;
-
-            // Factor 0.5 for the volume as it is split into two scatterers:
-            m_listOfPoints.push_back(getPoint(
-                distance, getScatterer(beam_energy, 0.5 * plane_distance / m_volumeMaterial, total_materialbudget)));
-            LOG(TRACE) << "Added volume scat at " << arclength;
-
-            // Propagate [mm] from 0 to 0.21 = 0.5 - 1/sqrt(12)
-            distance = 0.21 * plane_distance;
-            arclength += distance;
-            LOG(DEBUG) << "Added volume scatterers.";
-        } else {
-            // No volume scatterer defined (vacuum), simply propagate to the next plane:
-            distance = plane_distance;
         }
 
+        // Propagate to the next plane from the last point, i.e. over the full gap without volume scatterers (vacuum):
+        distance = pl->m_position - m_listOfPositions.back();
+        arclength = pl->m_position - planes.front().m_position;
+
         if(pl->m_measurement) {
-            gbl::GblPoint point(
-                getPoint(distance, pl->m_resolution, getScatterer(beam_energy, pl->m_materialbudget, total_materialbudget)));
-            // m_listOfPoints.push_back(getPoint(distance,pl->m_resolution,getScatterer(beam_energy,pl->m_materialbudget,total_materialbudget)));
-            Eigen::Matrix<double, 2, 4> addDer;
-            addDer.setZero();
+            auto plane_scatterer = scatter(pl->getMaterial(), pl->m_medium);
+            add_point(distance, plane_scatterer, &*pl);
             if(arcDUT > 0) {
-                addDer(0, 0) = (arclength - (arcDUT + size / sqrt(12))); // First scatterer in target
-                addDer(1, 1) = (arclength - (arcDUT + size / sqrt(12))); //
-                addDer(0, 2) = (arclength - (arcDUT - size / sqrt(12))); // second scatterer in target
-                addDer(1, 3) = (arclength - (arcDUT - size / sqrt(12))); //
-                LOG(DEBUG) << " size = " << size
-                           << " lever arm left DUT-point = " << (arclength - (arcDUT + size / sqrt(12)))
-                           << " and lever arm right DUT-point = " << (arclength - (arcDUT - size / sqrt(12)));
-
-                point.addLocals(addDer);
+                // Lever arms to the first and second scatterer in the target for the local derivatives:
+                m_listOfLevers.back() = {arclength - (arcDUT + sizeDUT / sqrt(12)),
+                                         arclength - (arcDUT - sizeDUT / sqrt(12))};
+                m_listOfLocals.back() = true;
+                LOG(DEBUG) << " size = " << sizeDUT << " lever arm left DUT-point = " << m_listOfLevers.back().first
+                           << " and lever arm right DUT-point = " << m_listOfLevers.back().second;
             }
-            m_listOfPoints.push_back(point);
+            m_listOfPositions.push_back(pl->m_position);
+            chainpoints.push_back({pl->m_position,
+                                   plane_scatterer[0],
+                                   measurement(*pl),
+                                   plane_index,
+                                   pl->getMaterial(),
+                                   velocity});
             LOG(DEBUG) << "Added plane at " << arclength << " (scatterer + measurement)";
             if(arcDUT > 0) {
                 LOG(DEBUG) << "                        + local derivative)";
             }
         } else if(!pl->m_measurement && pl->m_size < 0.0) {
-            m_listOfPoints.push_back(
-                getPoint(distance, getScatterer(beam_energy, pl->m_materialbudget, total_materialbudget)));
+            auto plane_scatterer = scatter(pl->getMaterial(), pl->m_medium);
+            add_point(distance, plane_scatterer, nullptr);
+            m_listOfPositions.push_back(pl->m_position);
+            chainpoints.push_back(
+                {pl->m_position, plane_scatterer[0], {0., 0.}, plane_index, pl->getMaterial(), velocity});
             LOG(DEBUG) << "Added plane at " << arclength << " (scatterer)";
         } else if(pl->m_size >= 0.0 && arcDUT < 0) {
             LOG(INFO) << " adding unknown scatterer at " << arclength
                       << ". Adding local derivatives for subsequent measurement points!! ";
             arcDUT = arclength;
-            size = pl->m_size;
+            sizeDUT = pl->m_size;
             m_parameter += 4;
+
+            // Two free kinks around a reference point at the center of the target:
+            chainpoints.push_back({pl->m_position - sizeDUT / sqrt(12), 0., {0., 0.}, no_plane, 0., velocity});
+            chainpoints.push_back(
+                {pl->m_position, std::numeric_limits<double>::infinity(), {0., 0.}, plane_index, 0., velocity});
+            chainpoints.push_back({pl->m_position + sizeDUT / sqrt(12), 0., {0., 0.}, no_plane, 0., velocity});
         } else if(pl->m_size >= 0.0 && arcDUT > 0) {
             LOG(ERROR) << " ___________________________________________________________________________________";
             LOG(ERROR) << " Software only supports one unknown scatterer! Ommitting further unknown scatterers!";
             LOG(ERROR) << " ___________________________________________________________________________________";
+            chainpoints.push_back(
+                {pl->m_position, std::numeric_limits<double>::infinity(), {0., 0.}, plane_index, 0., velocity});
         }
         // Update position of previous plane:
         oldpos = pl->m_position;
         // Store plane label:
-        m_listOfLabels.push_back(m_listOfPoints.size());
+        m_listOfLabels.push_back(m_listOfSteps.size());
+    }
+
+    std::stable_sort(chainpoints.begin(), chainpoints.end(), [](const chainpoint& a, const chainpoint& b) {
+        return a.position < b.position;
+    });
+    m_listOfChainPoints.resize(planes.size());
+    for(const auto& point : chainpoints) {
+        if(point.plane != no_plane) {
+            m_listOfChainPoints.at(point.plane) = m_chain.size();
+        }
+        m_chain.addPoint(point.position, point.scatterer, point.measurement);
+        m_listOfChainMaterials.push_back(point.material);
+        m_listOfChainMomenta.push_back(point.momentum);
     }
 
+    profiler::count(profiler::counter::telescopes);
+    profiler::count(profiler::counter::points, m_listOfSteps.size());
     LOG(DEBUG) << "Finished building trajectory.";
 }
 
+uint64_t telescope::getHash() const {
+    hasher hash;
+    hash.add(m_beamEnergy).add(m_mass);
+    for(const auto& segment : m_volumes) {
+        hash.add(segment.begin).add(segment.end).add(segment.radlength);
+    }
+    for(const auto& pl : m_planes) {
+        hash.add(pl.m_position).add(pl.m_materialbudget).add(pl.m_size);
+        hash.add(pl.m_resolution[0]).add(pl.m_resolution[1]).add(pl.m_tilt.first).add(pl.m_tilt.second);
+        hash.add(uint64_t((pl.m_measurement ? 1 : 0) | (pl.m_scatterer ? 2 : 0)));
+        // The medium enters through its properties, not its address:
+        hash.add(pl.m_medium->radlength).add(pl.m_medium->za).add(pl.m_medium->excitation).add(pl.m_medium->density);
+    }
+    // The cheap track models change the resolutions, the GBL fit leaves the hash of existing telescopes unchanged:
+    if(m_trackModel != trackmodel::gbl) {
+        hash.add(static_cast<uint64_t>(m_trackModel));
+    }
+    return hash.value();
+}
+
 double telescope::getTotalMaterialBudget(const std::vector<gblsim::plane>& planes) const {
 
+    PROFILE(material);
     LOG(DEBUG) << "Calculating total material budget in the particle path...";
     double total_materialbudget = 0;
 
     // Add the planes as scatterer:
     for(const auto& p : planes) {
-        LOG(TRACE) << "Adding x/X0=" << p.m_materialbudget;
-        total_materialbudget += p.m_materialbudget;
+        LOG(TRACE) << "Adding x/X0=" << p.getMaterial();
+        total_materialbudget += p.getMaterial();
     }
 
-    if(m_volumeMaterial > 0.0) {
-        // Add the air as scattering material:
-        double total_distance = (planes.back().m_position - planes.front().m_position);
-        LOG(TRACE) << "Adding x/X0=" << (total_distance / m_volumeMaterial) << " (air)";
-        total_materialbudget += total_distance / m_volumeMaterial;
+    // Add the volume segments between the first and the last plane as scattering material:
+    for(const auto& segment : m_volumes) {
+        double length = std::min(segment.end, planes.back().m_position) - std::max(segment.begin, planes.front().m_position);
+        if(segment.radlength > 0.0 && length > 0.0) {
+            LOG(TRACE) << "Adding x/X0=" << (length / segment.radlength) << " (volume)";
+            total_materialbudget += length / segment.radlength;
+        }
     }
 
     LOG(DEBUG) << "Total track material budget x/X0=" << total_materialbudget;
     return total_materialbudget;
 }
 
+std::vector<telescope::volumescatterer>
+telescope::getVolumeScatterers(const std::vector<volume>& volumes, double begin, double end) {
+
+    // Zeroth, first and second moment of the material distribution in the gap, and the segment with most material:
+    double total = 0., first = 0., second = 0.;
+    double dominant = 0., radlength = 0.;
+    for(const auto& segment : volumes) {
+        double lower = std::max(segment.begin, begin);
+        double upper = std::min(segment.end, end);
+        if(!(segment.radlength > 0.0) || !(upper > lower)) {
+            continue;
+        }
+        double material = (upper - lower) / segment.radlength;
+        double center = (upper + lower) / 2.;
+        total += material;
+        first += material * center;
+        second += material * (center * center + (upper - lower) * (upper - lower) / 12.);
+        if(material > dominant) {
+            dominant = material;
+            radlength = segment.radlength;
+        }
+    }
+    if(!(total > 0.)) {
+        return {};
+    }
+
+    // Two scatterers with half the material each at the mean position plus and minus the standard deviation reproduce
+    // all three moments, a single one suffices for material concentrated at one position:
+    const auto* matter = energyloss::find(radlength);
+    double mean = first / total;
+    double deviation = std::sqrt(std::max(second / total - mean * mean, 0.));
+    if(deviation < 1e-6 * (end - begin)) {
+        return {{mean, total, matter}};
+    }
+    return {{mean - deviation, total / 2., matter}, {mean + deviation, total / 2., matter}};
+}
+
+void telescope::checkVolumes(const std::vector<volume>& volumes, double mass) {
+    if(!(mass > 0.)) {
+        return;
+    }
+    for(const auto& segment : volumes) {
+        if(segment.radlength > 0.0 && energyloss::find(segment.radlength) == nullptr) {
+            LOG(WARNING) << "Volume material with X0 = " << segment.radlength
+                         << "mm not found in utils/materials.h, using the energy loss of air per radiation length";
+        }
+    }
+}
+
+std::vector<GblPoint> telescope::getPoints() const {
+
+    std::vector<GblPoint> points;
+    points.reserve(m_listOfSteps.size());
+    for(size_t p = 0; p < m_listOfSteps.size(); p++) {
+        Eigen::Vector2d scatterer(m_listOfScatterers[p], m_listOfScatterers[p]);
+        const auto& resolution = m_listOfResolutions[p];
+        if(resolution.first > 0. || resolution.second > 0.) {
+            Eigen::Matrix2d projection = Eigen::Matrix2d::Zero();
+            projection(0, 0) = m_listOfProjections[p].first;
+            projection(1, 1) = m_listOfProjections[p].second;
+            points.push_back(
+                getPoint(m_listOfSteps[p], Eigen::Vector2d(resolution.first, resolution.second), scatterer, projection));
+        } else {
+            points.push_back(getPoint(m_listOfSteps[p], scatterer));
+        }
+
+        if(m_listOfLocals[p]) {
+            Eigen::Matrix<double, 2, 4> addDer;
+            addDer.setZero();
+            addDer(0, 0) = m_listOfLevers[p].first; // First scatterer in target
+            addDer(1, 1) = m_listOfLevers[p].first;
+            addDer(0, 2) = m_listOfLevers[p].second; // second scatterer in target
+            addDer(1, 3) = m_listOfLevers[p].second;
+            points.back().addLocals(addDer);
+        }
+    }
+    return points;
+}
+
 GblTrajectory telescope::getTrajectory() const {
 
-    GblTrajectory traj(m_listOfPoints, 0);
+    PROFILE(trajectory);
+    GblTrajectory traj(getPoints(), 0);
     IFLOG(TRACE) { traj.printPoints(); }
     return traj;
 }
 
-std::pair<double, double> telescope::getResolutionXY(size_t plane) const {
+GblTrajectory telescope::getFittedTrajectory() const {
 
     GblTrajectory tr = getTrajectory();
 
     double c2, lw;
     int ndf;
 
-    tr.fit(c2, ndf, lw);
+    {
+        PROFILE(fit);
+        profiler::count(profiler::counter::fits);
+        tr.fit(c2, ndf, lw);
+    }
     LOG(TRACE) << " Fit: Chi2=" << c2 << ", Ndf=" << ndf << ", lostWeight=" << lw;
     IFLOG(TRACE) { tr.printTrajectory(); }
+    return tr;
+}
+
+void telescope::getResults(GblTrajectory& tr, int label, Eigen::VectorXd& corr, Eigen::MatrixXd& cov) const {
+    PROFILE(results);
+    profiler::count(profiler::counter::results);
+    tr.getResults(label, corr, cov);
+}
+
+std::pair<double, double> telescope::getResolutionXY(size_t plane) const {
+
+    if(m_trackModel != trackmodel::gbl) {
+        trackestimator estimator(m_trackModel);
+        auto point = getChainPoint(plane);
+        return std::make_pair(estimator.evaluate(m_chain, point, 0).position,
+                              estimator.evaluate(m_chain, point, 1).position);
+    }
+
+    GblTrajectory tr = getFittedTrajectory();
 
     Eigen::VectorXd aCorr(m_parameter);
     Eigen::MatrixXd aCov(m_parameter, m_parameter);
 
     // Get resolution at position of the DUT:
     if(plane < m_listOfLabels.size()) {
-        tr.getResults(static_cast<int>(m_listOfLabels.at(plane)), aCorr, aCov);
+        getResults(tr, static_cast<int>(m_listOfLabels.at(plane)), aCorr, aCov);
     }
     return std::make_pair(sqrt(aCov(3, 3)) * 1E3, sqrt(aCov(4, 4)) * 1E3);
 }
@@ -230,21 +462,20 @@ double telescope::getResolution(size_t plane) const {
 
 std::pair<double, double> telescope::getKinkResolutionXY(size_t plane) const {
 
-    GblTrajectory tr = getTrajectory();
+    if(m_trackModel != trackmodel::gbl) {
+        trackestimator estimator(m_trackModel);
+        auto point = getChainPoint(plane);
+        return std::make_pair(estimator.evaluate(m_chain, point, 0).kink, estimator.evaluate(m_chain, point, 1).kink);
+    }
 
-    double c2, lw;
-    int ndf;
-
-    tr.fit(c2, ndf, lw);
-    LOG(TRACE) << " Fit: Chi2=" << c2 << ", Ndf=" << ndf << ", lostWeight=" << lw;
-    IFLOG(TRACE) { tr.printTrajectory(); }
+    GblTrajectory tr = getFittedTrajectory();
 
     Eigen::VectorXd aCorr(m_parameter);
     Eigen::MatrixXd aCov(m_parameter, m_parameter);
 
     // Get resolution at position of the DUT:
     if(plane < m_listOfLabels.size()) {
-        tr.getResults(static_cast<int>(m_listOfLabels.at(plane)), aCorr, aCov);
+        getResults(tr, static_cast<int>(m_listOfLabels.at(plane)), aCorr, aCov);
     }
     return std::make_pair(sqrt(aCov(5, 5) + aCov(7, 7) + 2 * aCov(5, 7)) * 1E6,
                           sqrt(aCov(6, 6) + aCov(8, 8) + 2 * aCov(6, 8)) * 1E6);
@@ -254,6 +485,487 @@ double telescope::getKinkResolution(size_t plane) const {
     return std::get<0>(getKinkResolutionXY(plane));
 }
 
+std::vector<trackstate> telescope::getProfile(const std::vector<double>& positions) const {
+
+    GblTrajectory tr = getFittedTrajectory();
+
+    Eigen::VectorXd aCorr(m_parameter);
+    Eigen::MatrixXd aCov(m_parameter, m_parameter);
+
+    // Smoothed state of every point on the side towards the next point, plus the state in front of the first point.
+    // Between two points the track is a straight line, so these states can be propagated without loss of precision.
+    std::vector<trackstate> states(m_listOfSteps.size() + 1);
+    auto store = [&](trackstate& state, double position) {
+        state.position = position;
+        state.covX << aCov(3, 3), aCov(3, 1), aCov(1, 3), aCov(1, 1);
+        state.covY << aCov(4, 4), aCov(4, 2), aCov(2, 4), aCov(2, 2);
+    };
+    getResults(tr, -1, aCorr, aCov);
+    store(states.front(), m_listOfPositions.front());
+    for(size_t p = 0; p < m_listOfSteps.size(); p++) {
+        getResults(tr, static_cast<int>(p + 1), aCorr, aCov);
+        store(states.at(p + 1), m_listOfPositions.at(p));
+    }
+
+    std::vector<trackstate> profile;
+    profile.reserve(positions.size());
+    for(const auto& position : positions) {
+        // Last point upstream of the requested position, or the front side of the first point:
+        auto next = std::upper_bound(m_listOfPositions.begin(), m_listOfPositions.end(), position);
+        const auto& state = states.at(static_cast<size_t>(std::distance(m_listOfPositions.begin(), next)));
+
+        // Straight line propagation of the covariance, x = x0 + x' * dz:
+        double dz = position - state.position;
+        Eigen::Matrix2d jac;
+        jac << 1., dz, 0., 1.;
+        profile.push_back({position, jac * state.covX * jac.transpose(), jac * state.covY * jac.transpose()});
+    }
+
+    LOG(DEBUG) << "Evaluated track profile at " << profile.size() << " positions";
+    return profile;
+}
+
+std::pair<Eigen::MatrixXd, Eigen::MatrixXd> telescope::getJointCovariance(const std::vector<size_t>& planes) const {
+
+    std::vector<size_t> points;
+    points.reserve(planes.size());
+    for(const auto& pl : planes) {
+        points.push_back(m_listOfChainPoints.at(pl));
+    }
+
+    smoother x(m_chain, 0);
+    smoother y(m_chain, 1);
+    LOG(DEBUG) << "Evaluated joint covariance at " << planes.size() << " planes";
+    return std::make_pair(x.getCovariance(points), y.getCovariance(points));
+}
+
+std::vector<residual> telescope::getResidualWidths() const {
+
+    GblTrajectory tr = getFittedTrajectory();
+
+    Eigen::VectorXd aCorr(m_parameter);
+    Eigen::MatrixXd aCov(m_parameter, m_parameter);
+
+    std::vector<residual> residuals;
+    for(size_t pl = 0; pl < m_planes.size(); pl++) {
+        if(!m_planes.at(pl).m_measurement) {
+            continue;
+        }
+
+        getResults(tr, static_cast<int>(m_listOfLabels.at(pl)), aCorr, aCov);
+
+        // The biased residual variance is the hit variance reduced by the track variance, V_b = V_m - V_t.
+        // Removing the hit from the fit is a measurement downdate, the hat matrix identity gives V_u = V_m^2 / V_b.
+        auto widths = [](double res, double track) {
+            double biased = res * res - track;
+            return std::make_pair(sqrt(biased) * 1E3, res * res / sqrt(biased) * 1E3);
+        };
+        // Widths in the beam frame are projected on the measurement axes of tilted planes:
+        auto resolution = m_planes.at(pl).getProjectedResolution();
+        auto projection = m_planes.at(pl).getProjection();
+        auto x = widths(resolution.first, aCov(3, 3));
+        auto y = widths(resolution.second, aCov(4, 4));
+        residuals.push_back({pl,
+                             {x.first * projection.first, y.first * projection.second},
+                             {x.second * projection.first, y.second * projection.second}});
+        LOG(DEBUG) << "Plane " << pl << " residual width biased " << x.first << ", unbiased " << x.second;
+    }
+    return residuals;
+}
+
+hitmixture telescope::getHitPatterns(size_t plane, const std::vector<double>& efficiency, double cutoff) const {
+
+    hitmixture mixture{{}, 0., 0., {0., 0.}};
+
+    // Evaluate the plane together with all measurement planes:
+    std::vector<size_t> measurements;
+    std::vector<size_t> points{m_listOfChainPoints.at(plane)};
+    for(size_t pl = 0; pl < m_planes.size(); pl++) {
+        if(m_planes.at(pl).m_measurement) {
+            measurements.push_back(pl);
+            points.push_back(m_listOfChainPoints.at(pl));
+        }
+    }
+
+    // Position covariance of the plane (first) and all measured positions for both dimensions:
+    auto n = static_cast<Eigen::Index>(points.size());
+    std::array<Eigen::MatrixXd, 2> covariance;
+    for(size_t axis = 0; axis < 2; axis++) {
+        auto cov = smoother(m_chain, axis).getCovariance(points);
+        covariance[axis].resize(n, n);
+        for(Eigen::Index a = 0; a < n; a++) {
+            for(Eigen::Index b = 0; b < n; b++) {
+                covariance[axis](a, b) = cov(2 * a, 2 * b);
+            }
+        }
+    }
+
+    // Depth-first enumeration over hit and missing hit for each measurement plane:
+    std::vector<size_t> missing;
+    std::function<void(size_t, double, const std::array<Eigen::MatrixXd, 2>&)> visit =
+        [&](size_t level, double probability, const std::array<Eigen::MatrixXd, 2>& cov) {
+            if(probability < cutoff) {
+                mixture.pruned += probability;
+                return;
+            }
+            if(level == measurements.size()) {
+                mixture.patterns.push_back(
+                    {missing, probability, {sqrt(cov[0](0, 0)) * 1E3, sqrt(cov[1](0, 0)) * 1E3}});
+                return;
+            }
+
+            auto pl = measurements.at(level);
+            double eff = (pl < efficiency.size() ? efficiency.at(pl) : 1.);
+
+            // Plane has a hit, nothing changes:
+            visit(level + 1, probability * eff, cov);
+
+            // Plane has no hit, remove its measurement from the fit:
+            // V' = V + V e e^T V / (s^2 - V_kk), the denominator is the biased residual variance
+            if(probability * (1. - eff) < cutoff) {
+                mixture.pruned += probability * (1. - eff);
+                return;
+            }
+            auto k = static_cast<Eigen::Index>(level + 1);
+            std::array<Eigen::MatrixXd, 2> downdated;
+            for(size_t axis = 0; axis < 2; axis++) {
+                auto resolution = m_planes.at(pl).getProjectedResolution();
+                double variance = (axis == 0) ? resolution.first : resolution.second;
+                variance *= variance;
+                double denominator = variance - cov[axis](k, k);
+                if(!(denominator > 1e-9 * variance)) {
+                    // Track not constrained without this hit, same for all patterns derived from this one:
+                    mixture.untracked += probability * (1. - eff);
+                    return;
+                }
+                Eigen::VectorXd column = cov[axis].col(k);
+                downdated[axis] = cov[axis] + column * column.transpose() / denominator;
+            }
+            missing.push_back(pl);
+            visit(level + 1, probability * (1. - eff), downdated);
+            missing.pop_back();
+        };
+    visit(0, 1., covariance);
+
+    std::sort(mixture.patterns.begin(), mixture.patterns.end(), [](const hitpattern& a, const hitpattern& b) {
+        return a.probability > b.probability;
+    });
+
+    double weight = 0.;
+    for(const auto& pattern : mixture.patterns) {
+        weight += pattern.probability;
+        mixture.resolution.first += pattern.probability * pattern.resolution.first * pattern.resolution.first;
+        mixture.resolution.second += pattern.probability * pattern.resolution.second * pattern.resolution.second;
+    }
+    if(weight > 0.) {
+        mixture.resolution = {sqrt(mixture.resolution.first / weight), sqrt(mixture.resolution.second / weight)};
+    }
+
+    LOG(DEBUG) << "Evaluated " << mixture.patterns.size() << " hit patterns, untracked probability " << mixture.untracked
+               << ", pruned probability " << mixture.pruned;
+    return mixture;
+}
+
+std::pair<mixture, mixture>
+telescope::getResolutionMixture(size_t plane, const scattering& model, double cutoff, size_t components) const {
+
+    // Limit of the enumerated component combinations per dimension, independent of the cutoff:
+    const size_t max_leaves = 1 << 20;
+    auto bins = std::max(components, size_t(1));
+
+    // Evaluate the plane together with every point of the chain:
+    std::vector<size_t> points(m_chain.size() + 1);
+    points.front() = m_listOfChainPoints.at(plane);
+    std::iota(points.begin() + 1, points.end(), 0);
+
+    auto evaluate = [&](size_t axis) {
+        auto cov = smoother(m_chain, axis).getCovariance(points);
+
+        // Scatterers contribute g_k^2 theta_k^2 to the variance of the fixed estimator, with the sensitivity to the kink
+        // g_k = w_k Cov(x, theta_k) and theta_k the slope difference across the point:
+        struct kink {
+            std::vector<std::pair<double, double>> contributions;
+            double mean;
+            double spread;
+        };
+        std::vector<kink> kinks;
+        double nominal = cov(0, 0);
+        double base = nominal;
+        for(size_t k = 1; k < m_chain.size(); k++) {
+            double precision = m_chain.getScatterer(k);
+            if(!(precision > 0.) || std::isinf(precision)) {
+                continue;
+            }
+            auto col = static_cast<Eigen::Index>(2 * k + 3);
+            double gain = precision * (cov(0, col) - cov(0, col - 2));
+            base -= gain * gain / precision;
+
+            kink scatterer{{}, 0., 0.};
+            double min = std::numeric_limits<double>::max(), max = 0.;
+            auto widths = model.getComponents(getChainMomentum(k), m_listOfChainMaterials.at(k), m_totalMaterial);
+            for(const auto& component : widths) {
+                double contribution = gain * gain * component.second * component.second;
+                scatterer.contributions.emplace_back(component.first, contribution);
+                scatterer.mean += component.first * contribution;
+                min = std::min(min, contribution);
+                max = std::max(max, contribution);
+            }
+            scatterer.spread = max - min;
+
+            // Scatterers without significant effect only enter with their mean contribution:
+            if(scatterer.spread < 1e-3 * nominal) {
+                base += scatterer.mean;
+            } else {
+                kinks.push_back(scatterer);
+            }
+        }
+        std::sort(kinks.begin(), kinks.end(), [](const kink& a, const kink& b) { return a.spread > b.spread; });
+        LOG(DEBUG) << kinks.size() << " scatterers with significant tails for dimension " << axis;
+
+        // Mean contribution of all remaining scatterers, used to collapse improbable combinations:
+        std::vector<double> remainder(kinks.size() + 1, 0.);
+        for(size_t l = kinks.size(); l-- > 0;) {
+            remainder[l] = remainder[l + 1] + kinks[l].mean;
+        }
+
+        // Once the number of combinations reaches its limit, all open combinations are collapsed as well:
+        std::vector<std::pair<double, double>> leaves;
+        std::function<void(size_t, double, double)> visit = [&](size_t level, double probability, double variance) {
+            if(level == kinks.size() || probability < cutoff || leaves.size() >= max_leaves) {
+                leaves.emplace_back(probability, variance + remainder[level]);
+                return;
+            }
+            for(const auto& contribution : kinks[level].contributions) {
+                visit(level + 1, probability * contribution.first, variance + contribution.second);
+            }
+        };
+        visit(0, 1., base);
+        if(leaves.size() >= max_leaves) {
+            LOG(WARNING) << "Resolution mixture reached " << max_leaves << " combinations, collapsed the remaining ones";
+        }
+
+        // Combinations without probability do not contribute. A vanishing variance has no logarithm, such combinations
+        // can only come from a degenerate chain and are dropped with the fractions renormalized:
+        leaves.erase(std::remove_if(leaves.begin(),
+                                    leaves.end(),
+                                    [](const std::pair<double, double>& leaf) {
+                                        return !(leaf.first > 0.) || !(leaf.second > 0.) || !std::isfinite(leaf.second);
+                                    }),
+                     leaves.end());
+        if(leaves.empty()) {
+            throw std::runtime_error("no resolution mixture component with positive variance");
+        }
+
+        // Merge combinations into the requested number of components, equally spaced in the logarithm of the variance,
+        // preserving fraction and variance:
+        auto range = std::minmax_element(leaves.begin(), leaves.end(), [](const auto& a, const auto& b) {
+            return a.second < b.second;
+        });
+        double low = log(range.first->second);
+        double step = (log(range.second->second) - low) / static_cast<double>(bins) * (1. + 1e-9);
+        std::vector<std::pair<double, double>> merged(bins, {0., 0.});
+        double total = 0.;
+        for(const auto& leaf : leaves) {
+            auto bin = (step > 0. ? static_cast<size_t>((log(leaf.second) - low) / step) : 0);
+            merged[std::min(bin, bins - 1)].first += leaf.first;
+            merged[std::min(bin, bins - 1)].second += leaf.first * leaf.second;
+            total += leaf.first;
+        }
+
+        mixture result{{}, 0., 0.};
+        for(const auto& component : merged) {
+            if(component.first > 0.) {
+                result.components.emplace_back(component.first / total, sqrt(component.second / component.first) * 1E3);
+            }
+        }
+        std::sort(result.components.begin(), result.components.end(), [](const auto& a, const auto& b) {
+            return a.first > b.first;
+        });
+
+        // The core contains the dominant component and all components within 10% of its width:
+        double dominant = result.components.front().second;
+        double fraction = 0., variance = 0.;
+        for(const auto& component : result.components) {
+            if(component.second < 1.1 * dominant && component.second > dominant / 1.1) {
+                fraction += component.first;
+                variance += component.first * component.second * component.second;
+            }
+        }
+        result.core = sqrt(variance / fraction);
+        result.tail = 1. - fraction;
+        LOG(DEBUG) << "Resolution mixture from " << leaves.size() << " combinations: core " << result.core
+                   << "um, tail fraction " << result.tail;
+        return result;
+    };
+
+    return std::make_pair(evaluate(0), evaluate(1));
+}
+
+std::vector<targetresolution> telescope::getTargetScan(const std::vector<double>& positions,
+                                                       const std::vector<double>& sizes) const {
+
+    std::vector<targetresolution> scan;
+    scan.reserve(positions.size() * sizes.size());
+    for(const auto& size : sizes) {
+        for(const auto& position : positions) {
+            scan.push_back({position, size, {0., 0.}, {0., 0.}});
+        }
+    }
+
+    auto points = m_chain.size();
+    std::vector<double> along(points);
+    for(size_t k = 0; k < points; k++) {
+        along[k] = m_chain.getPosition(k);
+    }
+
+    for(size_t axis = 0; axis < 2; axis++) {
+        smoother arms(m_chain, axis);
+
+        for(auto& target : scan) {
+            double begin = target.position - target.size / sqrt(12);
+            double end = target.position + target.size / sqrt(12);
+
+            // Last point not behind the first kink and first point behind the second kink:
+            auto before = static_cast<size_t>(
+                std::distance(along.begin(), std::upper_bound(along.begin(), along.end(), begin)));
+            before = (before > 0) ? before - 1 : points;
+            auto after =
+                static_cast<size_t>(std::distance(along.begin(), std::upper_bound(along.begin(), along.end(), end)));
+
+            // Information upstream of the first kink:
+            Eigen::Matrix2d upstream = Eigen::Matrix2d::Zero();
+            if(before < points) {
+                auto jac = smoother::propagator(m_chain.getPosition(before) - begin);
+                upstream = jac.transpose() * arms.getForward(before) * jac;
+            }
+
+            // Information downstream of the second kink, including the first point behind it:
+            Eigen::Matrix2d downstream = Eigen::Matrix2d::Zero();
+            if(after < points) {
+                downstream = smoother::addKink(arms.getBackward(after), m_chain.getScatterer(after));
+                downstream(0, 0) += m_chain.getMeasurement(after, axis);
+                auto jac = smoother::propagator(m_chain.getPosition(after) - end);
+                downstream = jac.transpose() * downstream * jac;
+            }
+
+            // Parameters are position and slope in front of the target and the two kinks, the state behind the target
+            // follows as x + (x' + k1) d and x' + k1 + k2:
+            double d = end - begin;
+            Eigen::Matrix<double, 2, 4> behind;
+            behind << 1., d, d, 0., 0., 1., 1., 1.;
+            Eigen::Matrix4d information = behind.transpose() * downstream * behind;
+            information.topLeftCorner<2, 2>() += upstream;
+
+            Eigen::Vector4d center(1., d / 2, d / 2, 0.);
+            Eigen::Vector4d kink(0., 0., 1., 1.);
+            double position_variance = std::numeric_limits<double>::infinity();
+            double kink_variance = std::numeric_limits<double>::infinity();
+            // Unconstrained parameters leave the information singular, pivots are compared with the rounding threshold:
+            const double threshold = 4. * std::numeric_limits<double>::epsilon();
+            if(d > 0.) {
+                cholesky decomposition(information);
+                if(decomposition.isPositiveDefinite(threshold)) {
+                    position_variance = center.dot(decomposition.solve(center));
+                    kink_variance = kink.dot(decomposition.solve(kink));
+                }
+            } else {
+                // Both kinks coincide for a thin target:
+                cholesky decomposition(information.topLeftCorner<3, 3>());
+                if(decomposition.isPositiveDefinite(threshold)) {
+                    position_variance = center.head<3>().dot(decomposition.solve(center.head<3>()));
+                    kink_variance = kink.head<3>().dot(decomposition.solve(kink.head<3>()));
+                }
+            }
+
+            double resolution = sqrt(position_variance) * 1E3;
+            double kink_resolution = sqrt(kink_variance) * 1E6;
+            (axis == 0 ? target.resolution.first : target.resolution.second) = resolution;
+            (axis == 0 ? target.kink.first : target.kink.second) = kink_resolution;
+        }
+    }
+
+    LOG(DEBUG) << "Evaluated " << scan.size() << " target placements";
+    return scan;
+}
+
+std::vector<tiltresolution> telescope::getTiltScan(size_t plane,
+                                                   const std::vector<std::pair<double, double>>& angles,
+                                                   size_t target) const {
+
+    std::vector<tiltresolution> scan;
+    scan.reserve(angles.size());
+    for(const auto& angle : angles) {
+        scan.push_back({angle, {0., 0.}});
+    }
+
+    auto point = m_listOfChainPoints.at(plane);
+    auto goal = m_listOfChainPoints.at(target);
+    const auto& original = m_planes.at(plane);
+
+    for(size_t axis = 0; axis < 2; axis++) {
+        smoother arms(m_chain, axis);
+
+        // Information upstream of the tilted plane:
+        Eigen::Matrix2d upstream = Eigen::Matrix2d::Zero();
+        if(point > 0) {
+            auto jac = smoother::propagator(m_chain.getPosition(point - 1) - m_chain.getPosition(point));
+            upstream = jac.transpose() * arms.getForward(point - 1) * jac;
+        }
+
+        for(auto& tilt : scan) {
+            auto tilted = original;
+            tilted.setTilt(tilt.angles);
+
+            // Kink precision for the material along the tilted path and measurement precision in the beam frame:
+            double scatterer = m_chain.getScatterer(point);
+            if(original.m_scatterer && original.m_size < 0.) {
+                double total = m_totalMaterial - original.getMaterial() + tilted.getMaterial();
+                scatterer = getScatterer(getChainMomentum(point), tilted.getMaterial(), total)[0];
+            }
+            double measurement = 0.;
+            if(original.m_measurement) {
+                auto resolution = tilted.getProjectedResolution();
+                double width = (axis == 0 ? resolution.first : resolution.second);
+                measurement = 1. / width / width;
+            }
+
+            Eigen::Matrix2d information;
+            if(goal >= point) {
+                // Forward information behind the tilted plane, carried on to the target:
+                Eigen::Matrix2d forward = upstream;
+                forward(0, 0) += measurement;
+                forward = smoother::addKink(forward, scatterer);
+                for(size_t k = point + 1; k <= goal; k++) {
+                    auto jac = smoother::propagator(m_chain.getPosition(k - 1) - m_chain.getPosition(k));
+                    forward = jac.transpose() * forward * jac;
+                    forward(0, 0) += m_chain.getMeasurement(k, axis);
+                    forward = smoother::addKink(forward, m_chain.getScatterer(k));
+                }
+                information = forward + arms.getBackward(goal);
+            } else {
+                // Backward information including the tilted plane, carried back to the target:
+                Eigen::Matrix2d backward = arms.getBackward(point);
+                for(size_t k = point; k > goal; k--) {
+                    backward = smoother::addKink(backward, k == point ? scatterer : m_chain.getScatterer(k));
+                    backward(0, 0) += (k == point ? measurement : m_chain.getMeasurement(k, axis));
+                    auto jac = smoother::propagator(m_chain.getPosition(k) - m_chain.getPosition(k - 1));
+                    backward = jac.transpose() * backward * jac;
+                }
+                information = arms.getForward(goal) + backward;
+            }
+
+            double resolution = std::numeric_limits<double>::infinity();
+            if(information.determinant() > 0.) {
+                resolution = sqrt(information.inverse()(0, 0)) * 1E3;
+            }
+            (axis == 0 ? tilt.resolution.first : tilt.resolution.second) = resolution;
+        }
+    }
+
+    LOG(DEBUG) << "Evaluated " << scan.size() << " tilts of plane " << plane;
+    return scan;
+}
+
 void telescope::printLabels() const {
 
     for(size_t l = 0; l < m_listOfLabels.size(); l++) {
@@ -1,14 +1,21 @@
+#ifndef ASSEMBLY_H
+#define ASSEMBLY_H
+
 #include <utility>
 
 #include "GblTrajectory.h"
+#include "energyloss.h"
 #include "materials.h"
+#include "propagate.h"
+#include "smoother.h"
+#include "trackmodel.h"
 
 namespace gblsim {
     class plane {
     public:
-        // Virtual reference plane w/o material or measurement
+        // Virtual reference plane w/o material or measurement, a point of the trajectory without kink
         static plane reference(double position);
-        // A plane with material but no measurement
+        // A plane with known material but no measurement
         static plane inactive(double position, double material);
         // A plane with material and identical resolution along each axis
         static plane active(double position, double material, double resolution);
@@ -23,6 +30,15 @@ namespace gblsim {
 
         double position() const { return m_position; }
 
+        // Set the material of the plane for the energy loss, defaults to silicon
+        void setMedium(const medium& matter) { m_medium = &matter; }
+
+        // Tilt the plane normal by the given angles [rad] in the x-z and y-z planes. The material budget is scaled with the
+        // path length through the plane. The measurement axes lie along the intersections of the plane with the x-z and
+        // y-z planes and are projected on the beam frame, which improves the resolution by the cosine of the angle
+        void setTilt(std::pair<double, double> angles) { m_tilt = angles; }
+        std::pair<double, double> getTilt() const { return m_tilt; }
+
         bool operator<(const plane& pl) const { return (m_position < pl.m_position); }
 
     private:
@@ -33,12 +49,20 @@ namespace gblsim {
               std::pair<double, double> resolution,
               double size);
 
+        // Material budget along the beam, projection from the beam frame to the measurement axes and resolution in the
+        // beam frame for the tilt of the plane:
+        double getMaterial() const;
+        std::pair<double, double> getProjection() const;
+        std::pair<double, double> getProjectedResolution() const;
+
         bool m_measurement;
         Eigen::Vector2d m_resolution;
         bool m_scatterer;
         double m_materialbudget;
         double m_position;
         double m_size;
+        const medium* m_medium;
+        std::pair<double, double> m_tilt{0., 0.};
 
         void print() {
             std::cout << "Plane position = " << m_position << std::endl;
@@ -47,15 +71,107 @@ namespace gblsim {
         }
 
         friend class telescope;
+        friend class configurationset;
+        friend class prefixscan;
+    };
+
+    // Track state uncertainty at a given position along the beam axis
+    struct trackstate {
+        // Position along the beam in [mm]
+        double position;
+        // Covariance of (position, slope) in [mm] and [rad] for both dimensions
+        Eigen::Matrix2d covX;
+        Eigen::Matrix2d covY;
+    };
+
+    // Predicted residual widths at a plane with measurement
+    struct residual {
+        // Index of the plane
+        size_t plane;
+        // Residual widths in [um] with the hit of the plane included in (biased) or excluded from (unbiased) the fit
+        std::pair<double, double> biased;
+        std::pair<double, double> unbiased;
+    };
+
+    // Track resolution for one pattern of measurement planes with and without hit
+    struct hitpattern {
+        // Indices of the measurement planes without hit
+        std::vector<size_t> missing;
+        // Probability of the pattern
+        double probability;
+        // Resolution in [um] for both dimensions, infinite if the track is not constrained without these hits
+        std::pair<double, double> resolution;
+    };
+
+    // Resolution distribution over hit patterns for planes with limited efficiency
+    struct hitmixture {
+        // Patterns above the probability cutoff, ordered by decreasing probability
+        std::vector<hitpattern> patterns;
+        // Probability of patterns without constrained track
+        double untracked;
+        // Probability of patterns below the cutoff, not evaluated
+        double pruned;
+        // Probability-weighted RMS resolution in [um] of all evaluated patterns with constrained track
+        std::pair<double, double> resolution;
+    };
+
+    // Resolution distribution as a mixture of Gaussian components
+    struct mixture {
+        // Components as (fraction, width in [um]), ordered by decreasing fraction
+        std::vector<std::pair<double, double>> components;
+        // Width in [um] of the core, i.e. the dominant component merged with components of similar width
+        double core;
+        // Fraction of tracks outside the core
+        double tail;
+    };
+
+    // Resolution for an unknown target at a candidate position
+    struct targetresolution {
+        // Center position along the beam and size of the target in [mm]
+        double position;
+        double size;
+        // Position resolution at the target center in [um] and kink resolution in [urad] for both dimensions
+        std::pair<double, double> resolution;
+        std::pair<double, double> kink;
+    };
+
+    // Resolution for one tilt of a plane in an angle scan
+    struct tiltresolution {
+        // Tilt angles of the plane in [rad]
+        std::pair<double, double> angles;
+        // Position resolution at the target plane in [um] for both dimensions
+        std::pair<double, double> resolution;
+    };
+
+    // Segment of the volume along the beam filled with one material, e.g. air, a helium bag or an evacuated beam pipe
+    struct volume {
+        // Begin and end along the beam in [mm]
+        double begin;
+        double end;
+        // Radiation length in [mm], zero for vacuum
+        double radlength;
     };
 
     class telescope {
     public:
-        telescope(std::vector<gblsim::plane> planes, double beam_energy, double material = X0_Air);
+        // Telescope for particles of the given momentum and mass in [GeV]. For massless particles the momentum is constant
+        // along the telescope, otherwise the scattering widths are evaluated with p*beta and the momentum is reduced by the
+        // mean energy loss in every scatterer. Throws if the particle is stopped in the telescope. The volume material
+        // should be one of utils/materials.h to be matched, others are warned about and lose energy like air.
+        telescope(std::vector<gblsim::plane> planes, double beam_energy, double material = X0_Air, double mass = 0.);
+        // Telescope with the volume between the planes given as segments of different materials, overlapping segments add
+        // up. Every gap between planes gets the thin scatterers reproducing total, mean position and variance of its
+        // material: none for vacuum, one for material at a single position and two otherwise.
+        telescope(std::vector<gblsim::plane> planes, double beam_energy, std::vector<volume> volumes, double mass = 0.);
 
         // Return the trajectory
         gbl::GblTrajectory getTrajectory() const;
 
+        // Select the track model for the position and kink resolutions at the planes, defaults to the GBL fit. The cheap
+        // models are evaluated in closed form on the analytic chain, all other quantities are always from the GBL fit
+        void setTrackModel(trackmodel model) { m_trackModel = model; }
+        trackmodel getTrackModel() const { return m_trackModel; }
+
         // Return the resolution along the first dimension at given plane:
         double getResolution(size_t plane) const;
         // Return the resolution in both dimensions on the given plane
@@ -66,15 +182,122 @@ namespace gblsim {
         // Return the kink resolution in both dimensions on the given plane
         std::pair<double, double> getKinkResolutionXY(size_t plane) const;
 
+        // Return the track state covariance at arbitrary positions along the beam axis, obtained from a single fit
+        std::vector<trackstate> getProfile(const std::vector<double>& positions) const;
+
+        // Return the joint covariance of position and slope in [mm] and [rad] at the given planes for both dimensions,
+        // ordered as (position, slope) per plane in the given order. Obtained with the smoother lag recursion in a single
+        // sweep along the telescope
+        std::pair<Eigen::MatrixXd, Eigen::MatrixXd> getJointCovariance(const std::vector<size_t>& planes) const;
+
+        // Return the predicted biased and unbiased residual widths at all planes with measurement from a single fit
+        std::vector<residual> getResidualWidths() const;
+
+        size_t getNumberOfPlanes() const { return m_planes.size(); }
+        // Return the factors projecting the beam frame on the measurement axes of the given plane, one without tilt
+        std::pair<double, double> getProjection(size_t plane) const { return m_planes.at(plane).getProjection(); }
+
+        // Return the resolution distribution at the given plane for the given hit efficiencies of all planes. The hit
+        // patterns are enumerated with measurement downdates from one shared evaluation, patterns with probability below
+        // the cutoff are pruned together with all patterns derived from them
+        hitmixture getHitPatterns(size_t plane, const std::vector<double>& efficiency, double cutoff = 1e-6) const;
+
+        // Return the resolution distribution at the given plane for scattering angles following the given model, with
+        // the fit still assuming Highland widths. Scatterers with negligible effect are replaced by their mean
+        // contribution, component combinations below the probability cutoff are collapsed the same way and similar
+        // components are merged until at most the given number remains. At most 2^20 combinations are enumerated per
+        // dimension, the remaining ones are collapsed regardless of the cutoff
+        std::pair<mixture, mixture>
+        getResolutionMixture(size_t plane, const scattering& model, double cutoff = 1e-4, size_t components = 16) const;
+
+        // Return position and kink resolution of an unknown target placed at each of the given positions for each of the
+        // given sizes, ordered by size first. The target is modelled like plane::unknown with two free kinks at
+        // +-size/sqrt(12) around its center. The information of the telescope upstream and downstream of the target is
+        // taken from one forward and backward filter pass, so each candidate costs only a 4x4 solve. The telescope should
+        // not contain the target itself, points within the extent of a target are ignored.
+        std::vector<targetresolution> getTargetScan(const std::vector<double>& positions,
+                                                    const std::vector<double>& sizes = {0.}) const;
+
+        // Return the resolution at the target plane for each of the given tilts of a plane, e.g. for angle scans of a DUT
+        // or of shingled telescope planes. The information of the telescope upstream and downstream of the tilted plane
+        // is taken from one forward and backward filter pass, only its kink precision and projected measurement change
+        // with the angle. The other scatterers keep their widths, i.e. the total material in their Highland term is the
+        // one of the telescope as built.
+        std::vector<tiltresolution>
+        getTiltScan(size_t plane, const std::vector<std::pair<double, double>>& angles, size_t target) const;
+
+        // Return the analytic description of the trajectory and the point representing the given plane
+        const chain& getChain() const { return m_chain; }
+        size_t getChainPoint(size_t plane) const { return m_listOfChainPoints.at(plane); }
+        // Return the material budget x/X0 of the given point of the chain
+        double getChainMaterial(size_t point) const { return m_listOfChainMaterials.at(point); }
+        // Return the total material budget x/X0 along the track entering the logarithm of the Highland formula
+        double getTotalMaterial() const { return m_totalMaterial; }
+        // Return p*beta in [GeV] used for the scattering width of the given point of the chain
+        double getChainMomentum(size_t point) const { return m_listOfChainMomenta.at(point); }
+
+        double getBeamEnergy() const { return m_beamEnergy; }
+        double getMass() const { return m_mass; }
+
+        // Return a hash of the geometry, the plane properties, the beam and the surrounding volume, identifying the
+        // telescope e.g. for surrogates built from it
+        uint64_t getHash() const;
+
         void printLabels() const;
 
+        // Thin scatterer representing the volume material between two planes, with x/X0 and medium for the energy loss
+        struct volumescatterer {
+            double position;
+            double material;
+            const medium* matter;
+        };
+        // Return the moment-equivalent scatterers for the material of the volume segments between the given positions
+        static std::vector<volumescatterer>
+        getVolumeScatterers(const std::vector<volume>& volumes, double begin, double end);
+        // Warn about volume segments not matched to a medium of utils/materials.h, for particles with mass their energy
+        // loss per radiation length is taken from air
+        static void checkVolumes(const std::vector<volume>& volumes, double mass);
+
     private:
-        // Radiationlength of the material of the surrounding volume, defaults to dry air:
-        double m_volumeMaterial;
+        // Segments of the material of the surrounding volume, defaults to dry air everywhere:
+        std::vector<volume> m_volumes;
+        double m_beamEnergy;
+        double m_mass;
+        double m_totalMaterial;
+        trackmodel m_trackModel{trackmodel::gbl};
 
         double getTotalMaterialBudget(const std::vector<plane>& planes) const;
-        std::vector<gbl::GblPoint> m_listOfPoints;
+        // Build and fit the trajectory:
+        gbl::GblTrajectory getFittedTrajectory() const;
+        // Retrieve the fit results at the given point label:
+        void getResults(gbl::GblTrajectory& tr, int label, Eigen::VectorXd& corr, Eigen::MatrixXd& cov) const;
+
+        // Materialize the points of the trajectory for the GBL fit:
+        std::vector<gbl::GblPoint> getPoints() const;
+
+        // Planes of the telescope, ordered in z:
+        std::vector<plane> m_planes;
+        // Points of the trajectory with step from the previous point [mm], kink precision, measurement resolutions [mm]
+        // (zero without measurement) along the measurement axes, projection of the beam frame on these axes and lever
+        // arms to the two scatterers of an unknown target for local derivatives:
+        std::vector<double> m_listOfSteps;
+        std::vector<double> m_listOfScatterers;
+        std::vector<std::pair<double, double>> m_listOfResolutions;
+        std::vector<std::pair<double, double>> m_listOfProjections;
+        std::vector<std::pair<double, double>> m_listOfLevers;
+        std::vector<bool> m_listOfLocals;
+        // Position along the beam of every point of the trajectory:
+        std::vector<double> m_listOfPositions;
         std::vector<size_t> m_listOfLabels;
         unsigned int m_parameter;
+
+        // Same trajectory as field-wise chain for analytic evaluation, unknown scatterers become two free kinks:
+        chain m_chain;
+        std::vector<size_t> m_listOfChainPoints;
+        // Material budget x/X0 of every point of the chain:
+        std::vector<double> m_listOfChainMaterials;
+        std::vector<double> m_listOfChainMomenta;
     };
 } // namespace gblsim
+
+#endif /* ASSEMBLY_H */
@@ -0,0 +1,167 @@
+#include "checkpoint.h"
+
+#include "hash.h"
+#include "log.h"
+
+#include <cstring>
+#include <stdexcept>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace gblsim;
+using namespace unilog;
+
+namespace {
+    const char checkpoint_magic[] = "TRSCKPT1";
+
+    // Record header: grid index, number of results and length of the generator state
+    struct record_header {
+        uint64_t index;
+        uint32_t results;
+        uint32_t state;
+    };
+} // namespace
+
+checkpoint::checkpoint(const std::string& path, uint64_t configuration, size_t interval)
+    : m_path(path), m_file(std::fopen(path.c_str(), "r+b")), m_interval(interval), m_pending(0) {
+    if(m_file == nullptr) {
+        m_file = std::fopen(path.c_str(), "w+b");
+    }
+    if(m_file == nullptr) {
+        throw std::runtime_error("Could not open checkpoint file " + path);
+    }
+    // The destructor does not run if the constructor throws:
+    try {
+        restore(hasher().add(configuration).add(version).value());
+    } catch(...) {
+        std::fclose(m_file);
+        throw;
+    }
+    LOG(INFO) << "Checkpoint " << path << " holds " << m_results.size() << " completed grid points";
+}
+
+checkpoint::~checkpoint() {
+    if(m_file != nullptr) {
+        try {
+            sync();
+        } catch(std::runtime_error& e) {
+            LOG(ERROR) << e.what();
+        }
+        if(m_file != nullptr) {
+            std::fclose(m_file);
+        }
+    }
+}
+
+void checkpoint::restore(uint64_t configuration) {
+    char magic[8];
+    uint64_t stored = 0;
+    bool valid = (std::fread(magic, 1, 8, m_file) == 8 && std::memcmp(magic, checkpoint_magic, 8) == 0 &&
+                  std::fread(&stored, sizeof(stored), 1, m_file) == 1 && stored == configuration);
+
+    long end = 16;
+    if(valid) {
+        struct stat status {};
+        if(::fstat(fileno(m_file), &status) != 0) {
+            throw std::runtime_error("Could not determine size of checkpoint file");
+        }
+
+        // Read records until the end of the file or the first incomplete or corrupted record:
+        record_header header{};
+        while(std::fread(&header, sizeof(header), 1, m_file) == 1) {
+            // The sizes are not yet verified by the checksum and have to fit into the remainder of the file:
+            auto remaining = static_cast<uint64_t>(status.st_size - std::ftell(m_file));
+            if(uint64_t(header.results) * sizeof(double) + header.state + sizeof(uint64_t) > remaining) {
+                LOG(WARNING) << "Discarding truncated checkpoint record";
+                break;
+            }
+            std::vector<double> results(header.results);
+            std::string state(header.state, '\0');
+            uint64_t checksum = 0;
+            if(std::fread(results.data(), sizeof(double), results.size(), m_file) != results.size() ||
+               std::fread(&state[0], 1, state.size(), m_file) != state.size() ||
+               std::fread(&checksum, sizeof(checksum), 1, m_file) != 1) {
+                break;
+            }
+            hasher hash;
+            hash.add(&header, sizeof(header)).add(results.data(), results.size() * sizeof(double)).add(state);
+            if(hash.value() != checksum) {
+                LOG(WARNING) << "Discarding corrupted checkpoint record";
+                break;
+            }
+            m_results[header.index] = std::move(results);
+            m_state = std::move(state);
+            end = std::ftell(m_file);
+        }
+    } else {
+        if(stored != 0) {
+            LOG(WARNING) << "Checkpoint belongs to a different configuration, starting from scratch";
+        }
+        std::rewind(m_file);
+        if(std::fwrite(checkpoint_magic, 1, 8, m_file) != 8 ||
+           std::fwrite(&configuration, sizeof(configuration), 1, m_file) != 1) {
+            throw std::runtime_error("Could not write checkpoint file " + m_path);
+        }
+    }
+
+    // Drop a torn record at the end and continue appending after the last valid one:
+    if(std::fflush(m_file) != 0 || ::ftruncate(fileno(m_file), end) != 0) {
+        throw std::runtime_error("Could not write checkpoint file " + m_path);
+    }
+    std::fseek(m_file, end, SEEK_SET);
+}
+
+void checkpoint::record(uint64_t index, const std::vector<double>& results, const std::string& state) {
+    if(m_file == nullptr) {
+        throw std::logic_error("Checkpoint has already been removed or failed");
+    }
+    record_header header{index, static_cast<uint32_t>(results.size()), static_cast<uint32_t>(state.size())};
+    hasher hash;
+    hash.add(&header, sizeof(header)).add(results.data(), results.size() * sizeof(double)).add(state);
+    uint64_t checksum = hash.value();
+
+    if(std::fwrite(&header, sizeof(header), 1, m_file) != 1 ||
+       std::fwrite(results.data(), sizeof(double), results.size(), m_file) != results.size() ||
+       std::fwrite(state.data(), 1, state.size(), m_file) != state.size() ||
+       std::fwrite(&checksum, sizeof(checksum), 1, m_file) != 1) {
+        fail();
+    }
+
+    m_results[index] = results;
+    m_state = state;
+    if(++m_pending >= m_interval) {
+        sync();
+    }
+}
+
+void checkpoint::sync() {
+    if(m_pending == 0 || m_file == nullptr) {
+        return;
+    }
+    if(std::fflush(m_file) != 0 || ::fsync(fileno(m_file)) != 0) {
+        fail();
+    }
+    m_pending = 0;
+}
+
+void checkpoint::fail() {
+    // Records after a torn one cannot be restored, so the checkpoint is closed. Records synced before remain valid and
+    // the torn record is discarded on restart:
+    std::fclose(m_file);
+    m_file = nullptr;
+    m_pending = 0;
+    throw std::runtime_error("Could not write checkpoint file " + m_path);
+}
+
+void checkpoint::remove() {
+    if(m_file == nullptr) {
+        return;
+    }
+    std::fclose(m_file);
+    m_file = nullptr;
+    m_pending = 0;
+    if(std::remove(m_path.c_str()) != 0) {
+        LOG(WARNING) << "Could not remove checkpoint file " << m_path;
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace gblsim {
+
+    // Append-only checkpoint of a scan, storing the results of every completed grid point together with the state of the
+    // random number generator at that point. Each record carries a checksum, so a record torn by killing the job is
+    // detected and discarded on restart. Records are synced to disk periodically. A checkpoint written with a different
+    // configuration hash or format version is discarded and the scan starts from scratch. The configuration hash should
+    // include a version of the scan itself, as changes of the code are not detected otherwise.
+    class checkpoint {
+    public:
+        // Format version of the checkpoint file, part of the stored configuration hash
+        static constexpr uint64_t version = 2;
+
+        checkpoint(const std::string& path, uint64_t configuration, size_t interval = 100);
+        ~checkpoint();
+
+        checkpoint(const checkpoint&) = delete;
+        checkpoint& operator=(const checkpoint&) = delete;
+
+        // Return whether the grid point has been completed before and its stored results
+        bool isDone(uint64_t index) const { return m_results.count(index) > 0; }
+        const std::vector<double>& getResults(uint64_t index) const { return m_results.at(index); }
+        // Return the random number generator state stored with the last completed grid point
+        const std::string& getState() const { return m_state; }
+        size_t size() const { return m_results.size(); }
+
+        // Record the results of a completed grid point. Throws std::runtime_error if the record cannot be written, the
+        // checkpoint is closed then and records synced before are kept
+        void record(uint64_t index, const std::vector<double>& results, const std::string& state = "");
+        // Flush all records to disk, throws std::runtime_error and closes the checkpoint if this fails
+        void sync();
+        // Delete the checkpoint file once the scan is complete, no further records can be added
+        void remove();
+
+    private:
+        void restore(uint64_t configuration);
+        // Close the checkpoint after a failed write and throw
+        void fail();
+
+        std::string m_path;
+        std::FILE* m_file;
+        size_t m_interval;
+        size_t m_pending;
+
+        std::unordered_map<uint64_t, std::vector<double>> m_results;
+        std::string m_state;
+    };
+
+} // namespace gblsim
+
+#endif /* CHECKPOINT_H */
@@ -0,0 +1,76 @@
+#include "cholesky.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace gblsim;
+
+cholesky::cholesky(const Eigen::MatrixXd& matrix)
+    : m_size(static_cast<size_t>(matrix.rows())), m_lower(m_size * m_size, 0.), m_pivots(m_size, 0.), m_valid(true) {
+    auto at = [&](size_t i, size_t j) { return matrix(static_cast<Eigen::Index>(i), static_cast<Eigen::Index>(j)); };
+
+    for(size_t j = 0; j < m_size && m_valid; j++) {
+        double pivot = at(j, j);
+        for(size_t k = 0; k < j; k++) {
+            pivot -= m_lower[j * m_size + k] * m_lower[j * m_size + k];
+        }
+        m_pivots[j] = pivot;
+        m_valid = (pivot > 0.) && std::isfinite(pivot);
+        if(!m_valid) {
+            break;
+        }
+        double diagonal = std::sqrt(pivot);
+        m_lower[j * m_size + j] = diagonal;
+        for(size_t i = j + 1; i < m_size; i++) {
+            double value = at(i, j);
+            for(size_t k = 0; k < j; k++) {
+                value -= m_lower[i * m_size + k] * m_lower[j * m_size + k];
+            }
+            m_lower[i * m_size + j] = value / diagonal;
+        }
+    }
+}
+
+bool cholesky::isPositiveDefinite(double tolerance) const {
+    if(!m_valid || m_size == 0) {
+        return m_valid;
+    }
+    auto range = std::minmax_element(m_pivots.begin(), m_pivots.end());
+    return *range.first > tolerance * *range.second;
+}
+
+void cholesky::solve(std::vector<double>& x) const {
+    // Forward substitution with L, then backward substitution with L^T:
+    for(size_t i = 0; i < m_size; i++) {
+        for(size_t k = 0; k < i; k++) {
+            x[i] -= m_lower[i * m_size + k] * x[k];
+        }
+        x[i] /= m_lower[i * m_size + i];
+    }
+    for(size_t i = m_size; i-- > 0;) {
+        for(size_t k = i + 1; k < m_size; k++) {
+            x[i] -= m_lower[k * m_size + i] * x[k];
+        }
+        x[i] /= m_lower[i * m_size + i];
+    }
+}
+
+Eigen::VectorXd cholesky::solve(const Eigen::VectorXd& b) const {
+    std::vector<double> x(b.data(), b.data() + m_size);
+    solve(x);
+    return Eigen::Map<Eigen::VectorXd>(x.data(), b.size());
+}
+
+Eigen::MatrixXd cholesky::getInverse() const {
+    Eigen::MatrixXd inverse(m_size, m_size);
+    std::vector<double> column(m_size);
+    for(size_t j = 0; j < m_size; j++) {
+        std::fill(column.begin(), column.end(), 0.);
+        column[j] = 1.;
+        solve(column);
+        for(size_t i = 0; i < m_size; i++) {
+            inverse(static_cast<Eigen::Index>(i), static_cast<Eigen::Index>(j)) = column[i];
+        }
+    }
+    return inverse;
+}
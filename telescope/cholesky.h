@@ -0,0 +1,39 @@
+#ifndef CHOLESKY_H
+#define CHOLESKY_H
+
+#include <vector>
+
+#include <Eigen/Core>
+
+namespace gblsim {
+
+    // Cholesky decomposition A = L L^T of a symmetric positive definite matrix, for the small normal matrices of the
+    // resolution and alignment fits. Loops run over unsigned indices, avoiding the signed index arithmetic of the
+    // dynamic-size Eigen kernels which does not compile cleanly with -Wstrict-overflow.
+    class cholesky {
+    public:
+        // Decompose the given matrix, only its lower triangle is used
+        explicit cholesky(const Eigen::MatrixXd& matrix);
+
+        // Return whether the matrix is positive definite with all pivots above the given fraction of the largest one
+        bool isPositiveDefinite(double tolerance = 0.) const;
+
+        // Return the solution x of A x = b, only defined for positive definite matrices
+        Eigen::VectorXd solve(const Eigen::VectorXd& b) const;
+        // Return the inverse of A
+        Eigen::MatrixXd getInverse() const;
+
+    private:
+        // Solve A x = b in place
+        void solve(std::vector<double>& x) const;
+
+        size_t m_size;
+        // Lower triangle of L stored row by row, and the pivots L_jj^2:
+        std::vector<double> m_lower;
+        std::vector<double> m_pivots;
+        bool m_valid;
+    };
+
+} // namespace gblsim
+
+#endif /* CHOLESKY_H */
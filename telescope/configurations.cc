@@ -0,0 +1,96 @@
+#include "configurations.h"
+
+#include "log.h"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+using namespace gblsim;
+using namespace unilog;
+
+configurationset::configurationset(double beam_energy, double material, double mass)
+    : m_beamEnergy(beam_energy), m_volumeMaterial(material), m_mass(mass), m_offsets(1, 0) {}
+
+void configurationset::reserve(size_t configurations, size_t planes) {
+    m_offsets.reserve(configurations + 1);
+    for(auto* field : {&m_position, &m_material, &m_resolutionX, &m_resolutionY, &m_size}) {
+        field->reserve(planes);
+    }
+    m_flags.reserve(planes);
+    m_medium.reserve(planes);
+}
+
+size_t configurationset::add(const std::vector<plane>& planes) {
+    if(m_position.size() + planes.size() > std::numeric_limits<uint32_t>::max()) {
+        throw std::length_error("configuration set exceeds maximum number of planes");
+    }
+
+    for(const auto& pl : planes) {
+        m_position.push_back(pl.m_position);
+        m_material.push_back(pl.m_materialbudget);
+        m_resolutionX.push_back(pl.m_resolution[0]);
+        m_resolutionY.push_back(pl.m_resolution[1]);
+        m_size.push_back(pl.m_size);
+        bool tilt = (pl.m_tilt.first != 0. || pl.m_tilt.second != 0.);
+        m_flags.push_back(static_cast<uint8_t>((pl.m_measurement ? measurement : 0) | (pl.m_scatterer ? scatterer : 0) |
+                                               (tilt ? tilted : 0)));
+        if(tilt) {
+            m_tilted.push_back(static_cast<uint32_t>(m_position.size() - 1));
+            m_tilt.push_back(pl.m_tilt);
+        }
+
+        auto known = std::find(m_media.begin(), m_media.end(), pl.m_medium);
+        if(known == m_media.end()) {
+            if(m_media.size() > std::numeric_limits<uint8_t>::max()) {
+                throw std::length_error("configuration set exceeds maximum number of media");
+            }
+            known = m_media.insert(m_media.end(), pl.m_medium);
+        }
+        m_medium.push_back(static_cast<uint8_t>(std::distance(m_media.begin(), known)));
+    }
+    m_offsets.push_back(static_cast<uint32_t>(m_position.size()));
+    return size() - 1;
+}
+
+size_t configurationset::getNumberOfPlanes(size_t configuration) const {
+    return m_offsets.at(configuration + 1) - m_offsets.at(configuration);
+}
+
+std::vector<plane> configurationset::getPlanes(size_t configuration) const {
+    std::vector<plane> planes;
+    planes.reserve(getNumberOfPlanes(configuration));
+    for(size_t i = m_offsets.at(configuration); i < m_offsets.at(configuration + 1); i++) {
+        planes.push_back(plane(m_position[i],
+                               (m_flags[i] & scatterer) != 0,
+                               m_material[i],
+                               (m_flags[i] & measurement) != 0,
+                               {m_resolutionX[i], m_resolutionY[i]},
+                               m_size[i]));
+        planes.back().setMedium(*m_media[m_medium[i]]);
+        if((m_flags[i] & tilted) != 0) {
+            auto tilt = std::lower_bound(m_tilted.begin(), m_tilted.end(), static_cast<uint32_t>(i));
+            planes.back().setTilt(m_tilt[static_cast<size_t>(std::distance(m_tilted.begin(), tilt))]);
+        }
+    }
+    return planes;
+}
+
+telescope configurationset::getTelescope(size_t configuration) const {
+    return telescope(getPlanes(configuration), m_beamEnergy, m_volumeMaterial, m_mass);
+}
+
+chain configurationset::getChain(size_t configuration) const {
+    return getTelescope(configuration).getChain();
+}
+
+size_t configurationset::getMemory() const {
+    size_t bytes = m_offsets.capacity() * sizeof(uint32_t) + m_media.capacity() * sizeof(const medium*);
+    for(const auto* field : {&m_position, &m_material, &m_resolutionX, &m_resolutionY, &m_size}) {
+        bytes += field->capacity() * sizeof(double);
+    }
+    bytes += m_flags.capacity() + m_medium.capacity();
+    bytes += m_tilted.capacity() * sizeof(uint32_t) + m_tilt.capacity() * sizeof(std::pair<double, double>);
+    LOG(DEBUG) << "Configuration set with " << size() << " configurations holds " << bytes << " bytes";
+    return bytes;
+}
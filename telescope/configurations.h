@@ -0,0 +1,67 @@
+#ifndef CONFIGURATIONS_H
+#define CONFIGURATIONS_H
+
+#include <cstdint>
+#include <vector>
+
+#include "assembly.h"
+#include "energyloss.h"
+#include "smoother.h"
+
+namespace gblsim {
+
+    // Large set of telescope configurations sharing beam and volume material, e.g. candidate layouts for batch evaluation.
+    // The planes of all configurations are stored field by field in contiguous arrays with one byte of flags and one byte
+    // for the medium, about 40 bytes per plane, instead of one plane object with its own allocations per plane. Chains and
+    // telescopes are built on request for single configurations, GblPoints only when the GBL fit of a telescope is run.
+    class configurationset {
+    public:
+        configurationset(double beam_energy, double material = X0_Air, double mass = 0.);
+
+        // Reserve memory for the given number of configurations and planes in total
+        void reserve(size_t configurations, size_t planes);
+        // Append a configuration and return its index
+        size_t add(const std::vector<plane>& planes);
+
+        size_t size() const { return m_offsets.size() - 1; }
+        size_t getNumberOfPlanes(size_t configuration) const;
+
+        // Return the planes, the telescope or the analytic chain of the given configuration
+        std::vector<plane> getPlanes(size_t configuration) const;
+        telescope getTelescope(size_t configuration) const;
+        chain getChain(size_t configuration) const;
+
+        // Return the memory held by the set in bytes
+        size_t getMemory() const;
+
+    private:
+        enum flag : uint8_t {
+            measurement = 1,
+            scatterer = 2,
+            tilted = 4,
+        };
+
+        double m_beamEnergy;
+        double m_volumeMaterial;
+        double m_mass;
+
+        // Index of the first plane of every configuration, followed by the total number of planes:
+        std::vector<uint32_t> m_offsets;
+        // Position [mm], x/X0, resolutions [mm] and size [mm] of every plane:
+        std::vector<double> m_position;
+        std::vector<double> m_material;
+        std::vector<double> m_resolutionX;
+        std::vector<double> m_resolutionY;
+        std::vector<double> m_size;
+        std::vector<uint8_t> m_flags;
+        // Index of the medium of every plane in the list of media used:
+        std::vector<uint8_t> m_medium;
+        std::vector<const medium*> m_media;
+        // Tilt angles of the few tilted planes, with their plane index in ascending order:
+        std::vector<uint32_t> m_tilted;
+        std::vector<std::pair<double, double>> m_tilt;
+    };
+
+} // namespace gblsim
+
+#endif /* CONFIGURATIONS_H */
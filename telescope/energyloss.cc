@@ -0,0 +1,130 @@
+#include "energyloss.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+
+using namespace gblsim;
+
+namespace {
+    // Range and granularity of the tables in log(beta*gamma):
+    const double betagamma_min = 0.05;
+    const double betagamma_max = 1e6;
+    const size_t table_size = 512;
+
+    // Electron mass in [MeV] and Bethe coefficient K in [MeV cm2 / mol]:
+    const double electron_mass = 0.51099895;
+    const double bethe_k = 0.307075;
+
+    // Media of utils/materials.h:
+    const std::array<const medium*, 8> known_media = {&media::silicon,
+                                                      &media::diamond,
+                                                      &media::aluminium,
+                                                      &media::gold,
+                                                      &media::copper,
+                                                      &media::air,
+                                                      &media::kapton,
+                                                      &media::pcb};
+} // namespace
+
+energyloss::energyloss(const medium& matter)
+    : m_first(std::log(betagamma_min)), m_step((std::log(betagamma_max) - std::log(betagamma_min)) / (table_size - 1)),
+      m_loss(table_size) {
+
+    // Plasma energy in [eV] for the density effect:
+    double plasma = 28.816 * std::sqrt(matter.density * matter.za);
+
+    for(size_t i = 0; i < table_size; i++) {
+        double betagamma = std::exp(m_first + static_cast<double>(i) * m_step);
+        double beta2 = betagamma * betagamma / (1 + betagamma * betagamma);
+
+        // Maximum energy transfer to an electron in [MeV] for a heavy particle:
+        double tmax = 2 * electron_mass * betagamma * betagamma;
+        double excitation = matter.excitation * 1e-6;
+        double delta = std::max(0., 2 * (std::log(plasma / matter.excitation) + std::log(betagamma)) - 1);
+
+        // Mass stopping power in [MeV cm2 / g]:
+        double stopping = bethe_k * matter.za / beta2 *
+                          (0.5 * std::log(2 * electron_mass * betagamma * betagamma * tmax / excitation / excitation) -
+                           beta2 - delta / 2);
+
+        // Energy loss per radiation length in [GeV]:
+        m_loss[i] = std::max(stopping, 0.) * matter.density * matter.radlength * 0.1 * 1e-3;
+    }
+}
+
+const energyloss& energyloss::get(const medium& matter) {
+    // Tables of the media of utils/materials.h are built on first use, and are afterwards read without locking:
+    static const std::vector<energyloss> tables = [] {
+        std::vector<energyloss> known;
+        known.reserve(known_media.size());
+        for(const auto* entry : known_media) {
+            known.emplace_back(*entry);
+        }
+        return known;
+    }();
+    for(size_t i = 0; i < known_media.size(); i++) {
+        if(known_media[i] == &matter) {
+            return tables[i];
+        }
+    }
+
+    // Other media are computed once and shared by media with identical properties:
+    static std::mutex mutex;
+    static std::map<std::tuple<double, double, double, double>, std::unique_ptr<energyloss>> others;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto& table = others[std::make_tuple(matter.radlength, matter.za, matter.excitation, matter.density)];
+    if(!table) {
+        table = std::make_unique<energyloss>(matter);
+    }
+    return *table;
+}
+
+const medium* energyloss::find(double radlength) {
+    for(const auto* matter : known_media) {
+        if(matter->radlength == radlength) {
+            return matter;
+        }
+    }
+    return nullptr;
+}
+
+double energyloss::getLoss(double betagamma) const {
+    // Linear interpolation in log(beta*gamma), constant outside of the table:
+    double position = (std::log(std::max(betagamma, betagamma_min)) - m_first) / m_step;
+    auto index = std::min(static_cast<size_t>(position), table_size - 2);
+    double fraction = std::min(position - static_cast<double>(index), 1.);
+    return m_loss[index] + fraction * (m_loss[index + 1] - m_loss[index]);
+}
+
+double energyloss::getMomentum(double momentum, double mass, double radlength) const {
+    double energy = std::sqrt(momentum * momentum + mass * mass);
+    bool electron = (mass < 1e-3);
+
+    // Thick scatterers are crossed in steps losing at most 5% of the kinetic energy each:
+    double remaining = radlength;
+    for(size_t step = 0; step < 1000 && remaining > 0.; step++) {
+        double loss = getLoss(momentum / mass);
+        double length = std::min(remaining, 0.05 * (energy - mass) / loss);
+        energy -= loss * length;
+        if(electron) {
+            energy *= std::exp(-length);
+        }
+        remaining -= length;
+
+        // Particles slowed down below the range of the table are considered stopped:
+        if(energy <= mass) {
+            return 0.;
+        }
+        momentum = std::sqrt(energy * energy - mass * mass);
+        if(!electron && momentum < betagamma_min * mass) {
+            return 0.;
+        }
+    }
+    return momentum;
+}
@@ -0,0 +1,60 @@
+#ifndef ENERGYLOSS_H
+#define ENERGYLOSS_H
+
+#include <vector>
+
+#include "materials.h"
+
+namespace gblsim {
+
+    // Properties of a material relevant for the mean energy loss
+    struct medium {
+        // Radiation length in [mm]
+        double radlength;
+        // Ratio of atomic number and mass, mean excitation energy in [eV] and density in [g/cm3]
+        double za;
+        double excitation;
+        double density;
+    };
+
+    // Materials defined in utils/materials.h, unique across translation units so they can be compared by address
+    namespace media {
+        inline const medium silicon{X0_Si, ZA_Si, I_Si, RHO_Si};
+        inline const medium diamond{X0_Diamond, ZA_Diamond, I_Diamond, RHO_Diamond};
+        inline const medium aluminium{X0_Al, ZA_Al, I_Al, RHO_Al};
+        inline const medium gold{X0_Au, ZA_Au, I_Au, RHO_Au};
+        inline const medium copper{X0_Cu, ZA_Cu, I_Cu, RHO_Cu};
+        inline const medium air{X0_Air, ZA_Air, I_Air, RHO_Air};
+        inline const medium kapton{X0_Kapton, ZA_Kapton, I_Kapton, RHO_Kapton};
+        inline const medium pcb{X0_PCB, ZA_PCB, I_PCB, RHO_PCB};
+    } // namespace media
+
+    // Mean energy loss of a charged particle in one medium, tabulated per radiation length as function of beta*gamma.
+    // The ionization loss follows the Bethe formula with the asymptotic density effect correction and the maximum energy
+    // transfer of heavy particles. For electrons and positrons the mean bremsstrahlung loss is added. Tables are computed
+    // once per medium, so the energy loss at a scatterer costs a table lookup.
+    class energyloss {
+    public:
+        explicit energyloss(const medium& matter);
+
+        // Return the table of the given medium, computed on first use. The tables of the media of utils/materials.h are
+        // looked up without locking, others are shared by media with identical properties
+        static const energyloss& get(const medium& matter);
+        // Return the medium of utils/materials.h with the given radiation length [mm], or nullptr if unknown
+        static const medium* find(double radlength);
+
+        // Return the mean ionization energy loss in [GeV] per radiation length at the given beta*gamma
+        double getLoss(double betagamma) const;
+        // Return the momentum in [GeV] of a particle with given momentum and mass [GeV] after crossing the given x/X0,
+        // zero if the particle is stopped
+        double getMomentum(double momentum, double mass, double radlength) const;
+
+    private:
+        double m_first;
+        double m_step;
+        std::vector<double> m_loss;
+    };
+
+} // namespace gblsim
+
+#endif /* ENERGYLOSS_H */
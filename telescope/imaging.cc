@@ -0,0 +1,155 @@
+#include "imaging.h"
+
+#include "log.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+using namespace gblsim;
+using namespace unilog;
+
+imaging::imaging(double material, std::pair<double, double> kink, double beam_energy, double telescope_material)
+    : m_material(material), m_kink(kink), m_energy(beam_energy), m_telescopeMaterial(telescope_material), m_columns(1),
+      m_rows(1), m_pitch(1.), m_origin(0., 0.) {
+    m_single = {getPrecision(m_material)};
+}
+
+imaging::imaging(const telescope& tel, size_t plane, double material)
+    : imaging(material,
+              tel.getKinkResolutionXY(plane),
+              tel.getChainMomentum(tel.getChainPoint(plane)),
+              tel.getTotalMaterial()) {}
+
+void imaging::setGrid(size_t columns, size_t rows, double pitch, std::pair<double, double> origin) {
+    // A material map stays valid as long as the number of pixels is kept:
+    if(m_single.size() > 1 && columns * rows != m_columns * m_rows) {
+        LOG(WARNING) << "Grid of " << columns * rows << " pixels does not match the material map of " << m_single.size()
+                     << " pixels, using the uniform x/X0 " << m_material << " again";
+        m_single = {getPrecision(m_material)};
+    }
+    m_columns = columns;
+    m_rows = rows;
+    m_pitch = pitch;
+    m_origin = origin;
+}
+
+void imaging::setMaterial(const std::vector<double>& material) {
+    if(material.size() != m_columns * m_rows) {
+        LOG(ERROR) << "Material map with " << material.size() << " entries does not match the grid of "
+                   << m_columns * m_rows << " pixels, ignoring it";
+        return;
+    }
+    // Keep the previous map if any pixel is invalid:
+    std::vector<double> single(material.size());
+    std::transform(material.begin(), material.end(), single.begin(), [this](double x) { return getPrecision(x); });
+    m_single = std::move(single);
+}
+
+double imaging::getPrecision(double material) const {
+    // The relative precision is undefined without material:
+    if(!(material > 0.) || !std::isfinite(material)) {
+        throw std::invalid_argument("imaging requires a positive finite x/X0, got " + std::to_string(material));
+    }
+
+    // Highland variance theta^2 = a^2 x (1 + b ln(x + t))^2 with the telescope x/X0 t, and its derivative with respect
+    // to x:
+    double a = 0.0136 / m_energy;
+    double b = 0.038;
+    double total = material + m_telescopeMaterial;
+    double log_term = 1 + b * log(total);
+    double theta2 = a * a * material * log_term * log_term;
+    double slope = a * a * (log_term * log_term + 2 * b * log_term * material / total);
+
+    // Inverse variance of theta^2 from one track, combining both projections with kink resolution in [rad]:
+    double information = 0;
+    for(const auto& kink : {m_kink.first, m_kink.second}) {
+        double variance = theta2 + kink * kink * 1E-12;
+        information += 1. / (2. * variance * variance);
+    }
+
+    return 1. / sqrt(information) / std::abs(slope) / material;
+}
+
+double imaging::getTracks(double precision) const {
+    double single = getPrecision(m_material);
+    return single * single / precision / precision;
+}
+
+std::pair<std::vector<double>, std::vector<double>> imaging::getProfile(const beamprofile& beam) const {
+    // Integral of the Gaussian profile over the pixel edges:
+    auto integrate = [this](size_t pixels, double origin, double center, double width) {
+        std::vector<double> fraction(pixels);
+        auto cdf = [&](double edge) { return 0.5 * std::erfc(-(edge - center) / width / std::sqrt(2.)); };
+        double lower = cdf(origin);
+        for(size_t i = 0; i < pixels; i++) {
+            double upper = cdf(origin + static_cast<double>(i + 1) * m_pitch);
+            fraction[i] = upper - lower;
+            lower = upper;
+        }
+        return fraction;
+    };
+    return {integrate(m_columns, m_origin.first, beam.center.first, beam.width.first),
+            integrate(m_rows, m_origin.second, beam.center.second, beam.width.second)};
+}
+
+std::vector<double> imaging::getPrecisionMap(const beamprofile& beam, double time) const {
+    auto profile = getProfile(beam);
+
+    // The precision scales with 1/sqrt(tracks), evaluate the inverse square roots per column and row only once:
+    auto inverse_sqrt = [](std::vector<double>& values) {
+        for(auto& value : values) {
+            value = (value > 0.) ? 1. / std::sqrt(value) : std::numeric_limits<double>::infinity();
+        }
+    };
+    inverse_sqrt(profile.first);
+    inverse_sqrt(profile.second);
+
+    double scale = 1. / std::sqrt(beam.rate * time);
+    bool uniform = (m_single.size() == 1);
+    std::vector<double> map(m_columns * m_rows);
+    for(size_t row = 0; row < m_rows; row++) {
+        double row_scale = scale * profile.second[row];
+        double* pixel = map.data() + row * m_columns;
+        if(uniform) {
+            double factor = row_scale * m_single.front();
+            for(size_t column = 0; column < m_columns; column++) {
+                pixel[column] = factor * profile.first[column];
+            }
+        } else {
+            const double* single = m_single.data() + row * m_columns;
+            for(size_t column = 0; column < m_columns; column++) {
+                pixel[column] = row_scale * single[column] * profile.first[column];
+            }
+        }
+    }
+    return map;
+}
+
+std::vector<double> imaging::getBeamTimeMap(const beamprofile& beam, double precision) const {
+    // Precision after one second, the required time follows from t = (p_1s / p)^2:
+    auto map = getPrecisionMap(beam, 1.);
+    double inverse = 1. / precision / precision;
+    for(auto& pixel : map) {
+        pixel = pixel * pixel * inverse;
+    }
+    return map;
+}
+
+double imaging::getBeamTime(const beamprofile& beam, double precision, double fraction) const {
+    auto map = getBeamTimeMap(beam, precision);
+    if(map.empty()) {
+        return 0.;
+    }
+
+    // Time after which the requested fraction of pixels is below the precision:
+    auto pixels = static_cast<double>(map.size());
+    auto index = static_cast<size_t>(std::max(std::ceil(std::min(std::max(fraction, 0.), 1.) * pixels), 1.)) - 1;
+    std::nth_element(map.begin(), map.begin() + static_cast<std::ptrdiff_t>(index), map.end());
+    double time = map.at(index);
+    LOG(DEBUG) << "Beam time for " << fraction * 100 << "% of the pixels at " << precision * 100
+               << "% precision: " << time << "s";
+    return time;
+}
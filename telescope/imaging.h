@@ -0,0 +1,75 @@
+#ifndef IMAGING_H
+#define IMAGING_H
+
+#include <utility>
+#include <vector>
+
+#include "assembly.h"
+
+namespace gblsim {
+
+    // Beam with a Gaussian profile, separable in both dimensions
+    struct beamprofile {
+        // Rate of tracks through the target in [1/s]
+        double rate;
+        // Center and width of the profile in [mm]
+        std::pair<double, double> center;
+        std::pair<double, double> width;
+    };
+
+    // Forecast of the precision of a material budget image.
+    // The x/X0 of a pixel is obtained from the variance of the measured kink angles of its tracks, which is the Highland
+    // scattering variance plus the variance of the kink measurement. With n tracks and two projections the estimated
+    // variance of each projection has an uncertainty of sqrt(2/n) times its value, which is translated to x/X0 with the
+    // derivative of the Highland formula. As for the telescope scatterers, the logarithm of the Highland formula is taken
+    // of the total x/X0 along the track, i.e. the target plus the telescope. The relative precision of a pixel scales
+    // with 1/sqrt(n), so the map over a grid is the outer product of the beam profile integrated over the pixel columns
+    // and rows.
+    class imaging {
+    public:
+        // Image the given expected x/X0 with the kink resolution in [urad] for both dimensions and beam energy in [GeV],
+        // with the given x/X0 of the telescope without the target. All x/X0 of the target have to be positive
+        imaging(double material, std::pair<double, double> kink, double beam_energy, double telescope_material = 0.);
+        // Image the given expected x/X0 with the kink resolution and total material of the given plane of the telescope
+        imaging(const telescope& tel, size_t plane, double material);
+
+        // Define the image grid with the number of pixels in both dimensions, their pitch and the lower left corner [mm].
+        // A material map set before is kept if the number of pixels is unchanged, and replaced by the uniform x/X0 with a
+        // warning otherwise
+        void setGrid(size_t columns, size_t rows, double pitch, std::pair<double, double> origin);
+        // Set the expected x/X0 of every pixel, row by row, instead of a uniform material
+        void setMaterial(const std::vector<double>& material);
+
+        // Return the relative x/X0 precision for one track at the given x/X0, throws std::invalid_argument unless the
+        // x/X0 is positive and finite
+        double getPrecision(double material) const;
+        // Return the number of tracks required for the given relative precision at the expected x/X0
+        double getTracks(double precision) const;
+
+        // Return the relative x/X0 precision of every pixel after the given beam time in [s], row by row
+        std::vector<double> getPrecisionMap(const beamprofile& beam, double time) const;
+        // Return the beam time in [s] required for every pixel to reach the given relative precision, row by row
+        std::vector<double> getBeamTimeMap(const beamprofile& beam, double precision) const;
+        // Return the beam time in [s] after which the given fraction of pixels reaches the relative precision
+        double getBeamTime(const beamprofile& beam, double precision, double fraction = 1.) const;
+
+    private:
+        // Return the fraction of the beam in every pixel column and row
+        std::pair<std::vector<double>, std::vector<double>> getProfile(const beamprofile& beam) const;
+
+        double m_material;
+        std::pair<double, double> m_kink;
+        double m_energy;
+        double m_telescopeMaterial;
+
+        size_t m_columns;
+        size_t m_rows;
+        double m_pitch;
+        std::pair<double, double> m_origin;
+        // Relative precision for one track of every pixel, or of all pixels if only one entry:
+        std::vector<double> m_single;
+    };
+
+} // namespace gblsim
+
+#endif /* IMAGING_H */
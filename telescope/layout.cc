@@ -0,0 +1,198 @@
+#include "layout.h"
+
+#include "log.h"
+#include "smoother.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <exception>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+using namespace gblsim;
+using namespace unilog;
+
+layoutsearch::layoutsearch(std::vector<sensortype> catalog,
+                           std::vector<double> slots,
+                           plane dut,
+                           double beam_energy,
+                           double material,
+                           double mass)
+    : m_catalog(std::move(catalog)), m_slots(std::move(slots)), m_dut(std::move(dut)), m_beamEnergy(beam_energy),
+      m_material(material), m_mass(mass), m_objective(objective::cost),
+      m_threads(std::max(std::thread::hardware_concurrency(), 1u)), m_evaluations(0) {
+    std::sort(m_slots.begin(), m_slots.end());
+
+    // The ideal plane measures with the best resolution available in the catalog:
+    m_ideal = {std::numeric_limits<double>::infinity(), std::numeric_limits<double>::infinity()};
+    for(const auto& sensor : m_catalog) {
+        if(sensor.resolution.first > 0.) {
+            m_ideal.first = std::min(m_ideal.first, sensor.resolution.first);
+        }
+        if(sensor.resolution.second > 0.) {
+            m_ideal.second = std::min(m_ideal.second, sensor.resolution.second);
+        }
+    }
+}
+
+std::vector<plane> layoutsearch::getPlanes(const layout& candidate) const {
+    std::vector<plane> planes = {m_dut};
+    for(size_t slot = 0; slot < candidate.sensors.size() && slot < m_slots.size(); slot++) {
+        auto type = candidate.sensors[slot];
+        if(type >= m_catalog.size()) {
+            continue;
+        }
+        const auto& sensor = m_catalog[type];
+        if(sensor.resolution.first > 0.) {
+            planes.push_back(plane::active(m_slots[slot], sensor.material, sensor.resolution));
+        } else {
+            planes.push_back(plane::inactive(m_slots[slot], sensor.material));
+        }
+    }
+    return planes;
+}
+
+double layoutsearch::getBound(const std::vector<size_t>& sensors) const {
+    auto planes = getPlanes({sensors, 0., 0., 0.});
+    // Open slots are filled with ideal planes without material:
+    for(size_t slot = sensors.size(); slot < m_slots.size(); slot++) {
+        planes.push_back(plane::active(m_slots[slot], 0., m_ideal));
+    }
+
+    // Position and slope need at least two measurements:
+    size_t measurements = m_slots.size() - std::min(sensors.size(), m_slots.size());
+    for(const auto& type : sensors) {
+        if(type < m_catalog.size() && m_catalog[type].resolution.first > 0.) {
+            measurements++;
+        }
+    }
+    if(measurements < 2) {
+        return std::numeric_limits<double>::infinity();
+    }
+
+    auto dut = static_cast<size_t>(std::count_if(
+        planes.begin(), planes.end(), [this](const plane& pl) { return pl.position() < m_dut.position(); }));
+    telescope tel(planes, m_beamEnergy, m_material, m_mass);
+    return std::sqrt(smoother(tel.getChain(), 0).getCovariance(tel.getChainPoint(dut))(0, 0)) * 1E3;
+}
+
+std::vector<layout> layoutsearch::getParetoFront() {
+
+    // Assignment of the first slots with summed cost, material and bound on the resolution of all completions:
+    struct node {
+        std::vector<size_t> sensors;
+        double cost;
+        double material;
+        double bound;
+    };
+
+    auto empty = m_catalog.size();
+    auto threads = std::max(m_threads, size_t(1));
+    auto value = [this](double cost, double material) { return m_objective == objective::cost ? cost : material; };
+
+    std::vector<layout> front;
+    auto dominated = [&](double spent, double resolution) {
+        return std::any_of(front.begin(), front.end(), [&](const layout& candidate) {
+            return value(candidate.cost, candidate.material) <= spent && candidate.resolution <= resolution;
+        });
+    };
+
+    m_evaluations = 0;
+    size_t pruned = 0;
+    std::vector<node> stack = {{{}, 0., 0., 0.}};
+    while(!stack.empty()) {
+        // Take a batch from the top of the stack, nodes are skipped if already the bound of their parent is dominated:
+        std::vector<node> batch;
+        while(!stack.empty() && batch.size() < 16 * threads) {
+            auto candidate = std::move(stack.back());
+            stack.pop_back();
+            if(dominated(value(candidate.cost, candidate.material), candidate.bound)) {
+                pruned++;
+                continue;
+            }
+            batch.push_back(std::move(candidate));
+        }
+
+        std::atomic<size_t> next(0);
+        // The telescopes of the bounds are built without their INFO messages, the reporting level is thread-local:
+        auto level = Log::getReportingLevel();
+        auto quiet = std::min(level, LogLevel::WARNING);
+        auto format = Log::getFormat();
+        // The first exception of a bound stops all threads and is rethrown:
+        std::atomic<bool> abort(false);
+        std::mutex mutex;
+        std::exception_ptr error;
+        auto evaluate = [&]() {
+            Log::setReportingLevel(quiet);
+            Log::setFormat(format);
+            try {
+                for(size_t i = next++; i < batch.size() && !abort; i = next++) {
+                    batch[i].bound = getBound(batch[i].sensors);
+                }
+            } catch(...) {
+                std::lock_guard<std::mutex> lock(mutex);
+                if(!error) {
+                    error = std::current_exception();
+                }
+                abort = true;
+            }
+        };
+        std::vector<std::thread> workers;
+        for(size_t t = 1; t < std::min(threads, batch.size()); t++) {
+            workers.emplace_back(evaluate);
+        }
+        evaluate();
+        Log::setReportingLevel(level);
+        for(auto& worker : workers) {
+            worker.join();
+        }
+        if(error) {
+            std::rethrow_exception(error);
+        }
+        m_evaluations += batch.size();
+
+        for(auto& candidate : batch) {
+            double spent = value(candidate.cost, candidate.material);
+            if(!std::isfinite(candidate.bound) || dominated(spent, candidate.bound)) {
+                pruned++;
+                continue;
+            }
+
+            // Complete layouts enter the front and replace the layouts they dominate:
+            if(candidate.sensors.size() == m_slots.size()) {
+                front.erase(std::remove_if(front.begin(),
+                                           front.end(),
+                                           [&](const layout& other) {
+                                               return spent <= value(other.cost, other.material) &&
+                                                      candidate.bound <= other.resolution;
+                                           }),
+                            front.end());
+                front.push_back({candidate.sensors, candidate.bound, candidate.cost, candidate.material});
+                continue;
+            }
+
+            // Branch on the next slot, the empty slot is pushed first and therefore explored last:
+            for(size_t type = 0; type <= empty; type++) {
+                node child = candidate;
+                child.sensors.push_back(type);
+                if(type < empty) {
+                    child.cost += m_catalog[type].cost;
+                    child.material += m_catalog[type].material;
+                }
+                stack.push_back(std::move(child));
+            }
+        }
+    }
+
+    std::sort(front.begin(), front.end(), [&](const layout& a, const layout& b) {
+        return value(a.cost, a.material) < value(b.cost, b.material);
+    });
+
+    auto complete = std::pow(static_cast<double>(empty + 1), static_cast<double>(m_slots.size()));
+    LOG(INFO) << "Found " << front.size() << " layouts on the Pareto front with " << m_evaluations << " evaluations, "
+              << pruned << " pruned, " << complete << " complete layouts";
+    return front;
+}
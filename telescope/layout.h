@@ -0,0 +1,93 @@
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+#include <string>
+#include <vector>
+
+#include "assembly.h"
+
+namespace gblsim {
+
+    // Type of plane available for a telescope layout
+    struct sensortype {
+        std::string name;
+        // Material budget x/X0 of the full layer stack
+        double material;
+        // Intrinsic resolution along both dimensions in [mm]
+        std::pair<double, double> resolution;
+        // Cost of one plane in arbitrary units
+        double cost;
+    };
+
+    // Telescope layout assigning a plane type to every slot
+    struct layout {
+        // Index of the catalog entry in every slot, the size of the catalog for empty slots
+        std::vector<size_t> sensors;
+        // Resolution at the DUT in [um] along the first dimension
+        double resolution;
+        // Summed cost and x/X0 of all planes
+        double cost;
+        double material;
+    };
+
+    // Search for the layouts of planes from a catalog in a set of candidate slots with the best DUT resolution for a given
+    // cost or material budget. Slots are assigned in z, either empty or with one of the catalog types, and the Pareto
+    // front of resolution against cost or material is returned.
+    // Partial assignments are pruned by branch-and-bound: adding a measurement or removing material never degrades the
+    // resolution, so filling all open slots with an ideal plane without material and with the best resolution of the
+    // catalog bounds the resolution of every completion, while cost and material can only grow. A partial assignment is
+    // discarded once a layout on the front is at least as good in both. The bound neglects the different division of the
+    // air between planes, which is negligible compared to the planes. Bounds are evaluated in parallel batches.
+    class layoutsearch {
+    public:
+        enum class objective {
+            cost,
+            material,
+        };
+
+        // Search layouts of the given catalog in slots at the given positions [mm] around the DUT, for particles of the
+        // given momentum and mass in [GeV] and the given volume material
+        layoutsearch(std::vector<sensortype> catalog,
+                     std::vector<double> slots,
+                     plane dut,
+                     double beam_energy,
+                     double material = X0_Air,
+                     double mass = 0.);
+
+        // Select the quantity traded against the resolution, defaults to cost
+        void setObjective(objective target) { m_objective = target; }
+        // Set the number of threads evaluating candidates, defaults to the number of cores
+        void setThreads(size_t threads) { m_threads = threads; }
+
+        // Return the Pareto front of resolution against the objective, ordered by increasing objective. Layouts with
+        // unconstrained track at the DUT are not part of the front. Exceptions of the candidate telescopes, e.g. for
+        // particles stopped in the planes, stop the search and are rethrown
+        std::vector<layout> getParetoFront();
+
+        // Return the number of evaluated complete and partial layouts of the last search
+        size_t getEvaluations() const { return m_evaluations; }
+
+        // Return the planes of the given layout, including the DUT
+        std::vector<plane> getPlanes(const layout& candidate) const;
+
+    private:
+        // Return the resolution at the DUT of the given partial assignment with all open slots filled by the ideal plane
+        double getBound(const std::vector<size_t>& sensors) const;
+
+        std::vector<sensortype> m_catalog;
+        std::vector<double> m_slots;
+        plane m_dut;
+        double m_beamEnergy;
+        double m_material;
+        double m_mass;
+
+        objective m_objective;
+        size_t m_threads;
+        size_t m_evaluations;
+        // Best resolution of all catalog entries along both dimensions:
+        std::pair<double, double> m_ideal;
+    };
+
+} // namespace gblsim
+
+#endif /* LAYOUT_H */
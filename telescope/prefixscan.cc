@@ -0,0 +1,234 @@
+#include "prefixscan.h"
+
+#include "energyloss.h"
+#include "hash.h"
+#include "log.h"
+#include "propagate.h"
+#include "smoother.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+#include <Eigen/LU>
+
+using namespace gblsim;
+using namespace unilog;
+
+prefixscan::prefixscan(double beam_energy, double material, double mass)
+    : prefixscan(beam_energy,
+                 std::vector<volume>{{-std::numeric_limits<double>::infinity(),
+                                      std::numeric_limits<double>::infinity(),
+                                      material}},
+                 mass) {}
+
+prefixscan::prefixscan(double beam_energy, std::vector<volume> volumes, double mass)
+    : m_beamEnergy(beam_energy), m_volumes(std::move(volumes)), m_mass(mass) {
+    telescope::checkVolumes(m_volumes, m_mass);
+}
+
+size_t prefixscan::add(std::vector<plane> planes, size_t target) {
+    if(target >= planes.size()) {
+        throw std::invalid_argument("target plane out of range");
+    }
+    for(const auto& pl : planes) {
+        if(!pl.m_measurement && pl.m_size >= 0.) {
+            throw std::invalid_argument("unknown targets are not supported by the prefix scan");
+        }
+    }
+
+    // Same order as in the telescope:
+    std::sort(planes.begin(), planes.end());
+    m_configurations.push_back({std::move(planes), target});
+    return m_configurations.size() - 1;
+}
+
+double prefixscan::getTotalMaterial(const std::vector<plane>& planes) const {
+    double total = 0;
+    for(const auto& pl : planes) {
+        total += pl.getMaterial();
+    }
+    for(const auto& segment : m_volumes) {
+        double length = std::min(segment.end, planes.back().m_position) - std::max(segment.begin, planes.front().m_position);
+        if(segment.radlength > 0.0 && length > 0.0) {
+            total += length / segment.radlength;
+        }
+    }
+    return total;
+}
+
+std::vector<std::pair<double, double>> prefixscan::evaluate() {
+
+    std::vector<std::pair<double, double>> resolutions;
+    resolutions.reserve(m_configurations.size());
+    std::vector<size_t> path;
+    const size_t no_node = std::numeric_limits<size_t>::max();
+    using entry = std::pair<const uint64_t, size_t>;
+    auto same = [](const point& a, const point& b) {
+        return a.position == b.position && a.scatterer == b.scatterer && a.measurement == b.measurement;
+    };
+
+    for(const auto& config : m_configurations) {
+        const auto& planes = config.planes;
+        double total = getTotalMaterial(planes);
+
+        // Forward trie, every node is identified by its parent, its plane and the total material. Nodes are looked up
+        // by a hash of these, which is only trusted once the node itself matches:
+        path.clear();
+        uint64_t key = hasher().add(total).value();
+        for(size_t k = 0; k < planes.size(); k++) {
+            const auto& pl = planes[k];
+            auto resolution = pl.getProjectedResolution();
+            // The medium enters through its properties, not its address:
+            std::array<double, 9> description = {pl.m_position,
+                                                 pl.getMaterial(),
+                                                 resolution.first,
+                                                 resolution.second,
+                                                 pl.m_measurement ? 1. : 0.,
+                                                 pl.m_medium->radlength,
+                                                 pl.m_medium->za,
+                                                 pl.m_medium->excitation,
+                                                 pl.m_medium->density};
+            hasher next;
+            next.add(key);
+            for(const auto& value : description) {
+                next.add(value);
+            }
+            key = next.value();
+
+            auto parent_index = (k > 0 ? path.back() : no_node);
+            auto candidates = m_prefixIndex.equal_range(key);
+            auto found = std::find_if(candidates.first, candidates.second, [&](const entry& candidate) {
+                const auto& node = m_prefixes[candidate.second];
+                return node.parent == parent_index && node.total == total && node.description == description;
+            });
+            if(found == candidates.second) {
+                const prefix* parent = (k > 0 ? &m_prefixes[path.back()] : nullptr);
+                prefix node;
+                node.parent = parent_index;
+                node.total = total;
+                node.description = description;
+                node.momentum = (parent != nullptr ? parent->momentum : m_beamEnergy);
+
+                // Scattering with p*beta at the center of the scatterer, as in the telescope:
+                double velocity = m_beamEnergy;
+                auto scatter = [&](double radlength, const medium* matter) {
+                    if(m_mass > 0.) {
+                        const auto& table = energyloss::get(matter != nullptr ? *matter : media::air);
+                        double center = table.getMomentum(node.momentum, m_mass, 0.5 * radlength);
+                        node.momentum = table.getMomentum(center, m_mass, 0.5 * radlength);
+                        if(node.momentum <= 0.) {
+                            throw std::runtime_error("particle ranges out in the telescope");
+                        }
+                        velocity = center * center / std::sqrt(center * center + m_mass * m_mass);
+                    }
+                    return getScatterer(velocity, radlength, total)[0];
+                };
+
+                if(k > 0) {
+                    auto gap = telescope::getVolumeScatterers(m_volumes, planes[k - 1].m_position, pl.m_position);
+                    for(const auto& scatterer : gap) {
+                        node.points.push_back({scatterer.position, scatter(scatterer.material, scatterer.matter), {0., 0.}});
+                    }
+                }
+                auto measurement = pl.m_measurement ? std::make_pair(1. / resolution.first / resolution.first,
+                                                                     1. / resolution.second / resolution.second)
+                                                    : std::make_pair(0., 0.);
+                node.points.push_back({pl.m_position, scatter(pl.getMaterial(), pl.m_medium), measurement});
+
+                hasher content;
+                for(const auto& pt : node.points) {
+                    content.add(pt.position).add(pt.scatterer).add(pt.measurement.first).add(pt.measurement.second);
+                }
+                node.content = content.value();
+
+                found = m_prefixIndex.emplace(key, m_prefixes.size());
+                m_prefixes.push_back(std::move(node));
+            }
+
+            // Forward filter over the points of the unit, only needed up to the target:
+            auto& unit = m_prefixes[found->second];
+            if(k <= config.target && !unit.filtered) {
+                const prefix* parent = (k > 0 ? &m_prefixes[path.back()] : nullptr);
+                for(size_t axis = 0; axis < 2; axis++) {
+                    Eigen::Matrix2d info = (parent != nullptr ? parent->forward[axis] : Eigen::Matrix2d::Zero());
+                    double last = (parent != nullptr ? planes[k - 1].m_position : pl.m_position);
+                    for(const auto& pt : unit.points) {
+                        auto jac = smoother::propagator(last - pt.position);
+                        info = jac.transpose() * info * jac;
+                        info(0, 0) += (axis == 0 ? pt.measurement.first : pt.measurement.second);
+                        info = smoother::addKink(info, pt.scatterer);
+                        last = pt.position;
+                    }
+                    unit.forward[axis] = info;
+                }
+                unit.filtered = true;
+                m_steps += unit.points.size();
+            }
+            path.push_back(found->second);
+            m_unshared += 2 * unit.points.size();
+        }
+
+        // Backward trie over the units behind the target, identified by the suffix behind, the points of the unit and the
+        // position of the plane in front of it:
+        Eigen::Matrix2d backward[2] = {Eigen::Matrix2d::Zero(), Eigen::Matrix2d::Zero()};
+        uint64_t suffix_key = hasher().value();
+        auto behind = no_node;
+        for(size_t k = planes.size(); k-- > config.target + 1;) {
+            const auto& unit = m_prefixes[path[k]];
+            suffix_key = hasher().add(suffix_key).add(unit.content).add(planes[k - 1].m_position).value();
+
+            auto candidates = m_suffixIndex.equal_range(suffix_key);
+            auto found = std::find_if(candidates.first, candidates.second, [&](const entry& candidate) {
+                const auto& node = m_suffixes[candidate.second];
+                const auto& points = m_prefixes[node.unit].points;
+                return node.next == behind && node.front == planes[k - 1].m_position &&
+                       std::equal(points.begin(), points.end(), unit.points.begin(), unit.points.end(), same);
+            });
+            if(found == candidates.second) {
+                suffix node;
+                node.next = behind;
+                node.unit = path[k];
+                node.front = planes[k - 1].m_position;
+                for(size_t axis = 0; axis < 2; axis++) {
+                    Eigen::Matrix2d info = backward[axis];
+                    for(size_t p = unit.points.size(); p-- > 0;) {
+                        const auto& pt = unit.points[p];
+                        double previous = (p > 0 ? unit.points[p - 1].position : planes[k - 1].m_position);
+                        info = smoother::addKink(info, pt.scatterer);
+                        info(0, 0) += (axis == 0 ? pt.measurement.first : pt.measurement.second);
+                        auto jac = smoother::propagator(pt.position - previous);
+                        info = jac.transpose() * info * jac;
+                    }
+                    node.backward[axis] = info;
+                }
+                m_steps += unit.points.size();
+
+                found = m_suffixIndex.emplace(suffix_key, m_suffixes.size());
+                m_suffixes.push_back(node);
+            }
+            behind = found->second;
+            backward[0] = m_suffixes[found->second].backward[0];
+            backward[1] = m_suffixes[found->second].backward[1];
+        }
+
+        // Combine both filters at the target plane:
+        std::pair<double, double> resolution;
+        for(size_t axis = 0; axis < 2; axis++) {
+            Eigen::Matrix2d info = m_prefixes[path[config.target]].forward[axis] + backward[axis];
+            double width = std::numeric_limits<double>::infinity();
+            if(info.determinant() > 0.) {
+                width = std::sqrt(info.inverse()(0, 0)) * 1E3;
+            }
+            (axis == 0 ? resolution.first : resolution.second) = width;
+        }
+        resolutions.push_back(resolution);
+    }
+
+    LOG(DEBUG) << "Evaluated " << m_configurations.size() << " configurations with " << m_prefixes.size()
+               << " distinct prefixes and " << m_suffixes.size() << " distinct suffixes, " << m_steps << " of "
+               << m_unshared << " filter steps";
+    return resolutions;
+}
@@ -0,0 +1,96 @@
+#ifndef PREFIXSCAN_H
+#define PREFIXSCAN_H
+
+#include <array>
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <Eigen/Core>
+
+#include "assembly.h"
+
+namespace gblsim {
+
+    // Resolution at one plane for many telescope configurations which share planes, e.g. scans moving only the DUT or the
+    // downstream arm. Every configuration is split into units of one plane together with the volume scatterers in the
+    // gap in front of it. Configurations are organized in a trie by their units in z order and the forward filter state
+    // behind every unit is computed once per distinct prefix. The backward filter states are shared the same way over
+    // distinct suffixes, so the cost follows the number of distinct units rather than configurations times planes.
+    // The Highland width of every scatterer depends on the total material of the configuration, so prefixes are only
+    // shared between configurations with identical total material and the result equals the smoother of each telescope.
+    // With mass, suffixes are only shared if the particle enters them with identical momentum.
+    class prefixscan {
+    public:
+        prefixscan(double beam_energy, double material = X0_Air, double mass = 0.);
+        prefixscan(double beam_energy, std::vector<volume> volumes, double mass = 0.);
+
+        // Add a configuration with the index of the plane in z order at which the resolution is evaluated, return the index
+        // of the configuration. Unknown targets are not supported, see telescope::getTargetScan()
+        size_t add(std::vector<plane> planes, size_t target);
+        size_t size() const { return m_configurations.size(); }
+
+        // Return the resolution in [um] for both dimensions at the target plane of every configuration
+        std::vector<std::pair<double, double>> evaluate();
+
+        // Return the number of filter steps computed so far, and the number of steps without any sharing
+        size_t getSteps() const { return m_steps; }
+        size_t getUnsharedSteps() const { return m_unshared; }
+
+    private:
+        // Point of the chain with position [mm], kink precision and measurement precisions
+        struct point {
+            double position;
+            double scatterer;
+            std::pair<double, double> measurement;
+        };
+
+        // Node of the forward trie: parent node, total material of the configuration and description of the plane of the
+        // unit identifying the node, points of the unit with a hash of their content, momentum of the particle leaving the
+        // unit and forward information behind its last point for both axes, filtered only once a target requires it
+        struct prefix {
+            size_t parent;
+            double total;
+            std::array<double, 9> description;
+            std::vector<point> points;
+            uint64_t content;
+            double momentum;
+            Eigen::Matrix2d forward[2];
+            bool filtered{false};
+        };
+
+        // Node of the backward trie: suffix node behind, prefix node holding the points of the unit and position of the
+        // plane in front of it identifying the node, information from all units of the suffix at that position
+        struct suffix {
+            size_t next;
+            size_t unit;
+            double front;
+            Eigen::Matrix2d backward[2];
+        };
+
+        struct configuration {
+            std::vector<plane> planes;
+            size_t target;
+        };
+
+        // Return the total material budget of a configuration, entering the Highland width of all its scatterers
+        double getTotalMaterial(const std::vector<plane>& planes) const;
+
+        double m_beamEnergy;
+        std::vector<volume> m_volumes;
+        double m_mass;
+
+        std::vector<configuration> m_configurations;
+        std::vector<prefix> m_prefixes;
+        std::vector<suffix> m_suffixes;
+        // Nodes by the hash of their identity, colliding nodes are told apart by comparing the identity itself:
+        std::unordered_multimap<uint64_t, size_t> m_prefixIndex;
+        std::unordered_multimap<uint64_t, size_t> m_suffixIndex;
+        size_t m_steps{0};
+        size_t m_unshared{0};
+    };
+
+} // namespace gblsim
+
+#endif /* PREFIXSCAN_H */
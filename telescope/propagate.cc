@@ -1,5 +1,9 @@
 #include "propagate.h"
 
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
 gbl::Matrix5d gblsim::Jac5(double ds) {
     /*
        straight line, no B-field
@@ -32,9 +36,59 @@ Eigen::Vector2d gblsim::getScatterer(double energy, double radlength, double tot
     return scat;
 }
 
+std::vector<std::pair<double, double>>
+gblsim::highland::getComponents(double energy, double radlength, double total_radlength) const {
+    return {{1.0, getTheta(energy, radlength, total_radlength)}};
+}
+
+gblsim::gaussianmixture::gaussianmixture(std::vector<std::pair<double, double>> components)
+    : m_components(std::move(components)) {
+    // Components without width would give a vanishing variance, components without fraction never contribute:
+    for(const auto& component : m_components) {
+        if(!(component.first >= 0.) || !(component.second > 0.) || !std::isfinite(component.second)) {
+            throw std::invalid_argument("mixture components need a non-negative fraction and a positive finite width");
+        }
+    }
+    m_components.erase(std::remove_if(m_components.begin(),
+                                      m_components.end(),
+                                      [](const std::pair<double, double>& component) { return component.first == 0.; }),
+                       m_components.end());
+
+    // Normalize the fractions:
+    double sum = 0;
+    for(const auto& component : m_components) {
+        sum += component.first;
+    }
+    if(!(sum > 0.) || !std::isfinite(sum)) {
+        throw std::invalid_argument("mixture needs components with a positive total fraction");
+    }
+    for(auto& component : m_components) {
+        component.first /= sum;
+    }
+}
+
+std::vector<std::pair<double, double>>
+gblsim::gaussianmixture::getComponents(double energy, double radlength, double total_radlength) const {
+    double theta = getTheta(energy, radlength, total_radlength);
+
+    std::vector<std::pair<double, double>> components;
+    for(const auto& component : m_components) {
+        components.emplace_back(component.first, component.second * theta);
+    }
+    return components;
+}
+
 // construct a GblPoint with a scatterer and a measurement
 gbl::GblPoint gblsim::getPoint(double dz, const Eigen::Vector2d& res, const Eigen::Vector2d& wscat) {
 
+    // measurement plane == propagation plane
+    return getPoint(dz, res, wscat, Eigen::Matrix2d::Identity());
+}
+
+// construct a GblPoint with a scatterer and a measurement with the given projection from the track frame
+gbl::GblPoint
+gblsim::getPoint(double dz, const Eigen::Vector2d& res, const Eigen::Vector2d& wscat, const Eigen::Matrix2d& proL2m) {
+
     // Propagate:
     auto jacPointToPoint = Jac5(dz);
     gbl::GblPoint point(jacPointToPoint);
@@ -51,9 +105,6 @@ gbl::GblPoint gblsim::getPoint(double dz, const Eigen::Vector2d& res, const Eige
     Eigen::Vector2d measPrec;
     measPrec << 1.0 / res[0] / res[0], 1.0 / res[1] / res[1];
 
-    // measurement plane == propagation plane
-    Eigen::Matrix2d proL2m;
-    proL2m.setIdentity();
     point.addMeasurement(proL2m, meas, measPrec);
 
     return point;
@@ -1,3 +1,9 @@
+#ifndef PROPAGATE_H
+#define PROPAGATE_H
+
+#include <utility>
+#include <vector>
+
 #include <Eigen/Core>
 
 #include "GblData.h"
@@ -5,12 +11,48 @@
 
 namespace gblsim {
 
+    // Model of the projected scattering angle distribution of a thin scatterer as a mixture of Gaussian components. The
+    // track fit always assumes the Highland width, models describe the actual distribution for getResolutionMixture
+    class scattering {
+    public:
+        virtual ~scattering() = default;
+
+        // Return the (fraction, width) components of the actual scattering angle distribution
+        virtual std::vector<std::pair<double, double>>
+        getComponents(double energy, double radlength, double total_radlength) const = 0;
+    };
+
+    // Single Gaussian with the width given by the Highland formula
+    class highland : public scattering {
+    public:
+        std::vector<std::pair<double, double>>
+        getComponents(double energy, double radlength, double total_radlength) const override;
+    };
+
+    // Gaussian mixture with components given as (fraction, width relative to the Highland width), e.g. a narrow core
+    // with one or two wider components describing the single scattering tails
+    class gaussianmixture : public scattering {
+    public:
+        explicit gaussianmixture(std::vector<std::pair<double, double>> components);
+
+        std::vector<std::pair<double, double>>
+        getComponents(double energy, double radlength, double total_radlength) const override;
+
+    private:
+        std::vector<std::pair<double, double>> m_components;
+    };
+
     gbl::Matrix5d Jac5(double ds);
     double getTheta(double energy, double radlength, double total_radlength);
     Eigen::Vector2d getScatterer(double energy, double radlength, double total_radlength);
     gbl::GblPoint getPoint(double dz, double res, const Eigen::Vector2d& wscat);
     gbl::GblPoint getPoint(double dz, const Eigen::Vector2d& res, const Eigen::Vector2d& wscat);
+    // Point with measurement along axes given by the projection from the track frame, e.g. of a tilted plane
+    gbl::GblPoint
+    getPoint(double dz, const Eigen::Vector2d& res, const Eigen::Vector2d& wscat, const Eigen::Matrix2d& proL2m);
     gbl::GblPoint getPoint(double dz, const Eigen::Vector2d& wscat);
     gbl::GblPoint getMarker(double dz);
 
 } // namespace gblsim
+
+#endif /* PROPAGATE_H */
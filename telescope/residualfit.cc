@@ -0,0 +1,203 @@
+#include "residualfit.h"
+
+#include "cholesky.h"
+#include "log.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+using namespace gblsim;
+using namespace unilog;
+
+residualfit::residualfit(const telescope& tel)
+    : m_chain(tel.getChain()), m_numberOfPlanes(tel.getNumberOfPlanes()), m_iterations(0, 0), m_chi2(0., 0.) {
+    for(size_t pl = 0; pl < tel.getNumberOfPlanes(); pl++) {
+        auto point = tel.getChainPoint(pl);
+        if(m_chain.getMeasurement(point, 0) > 0. && m_chain.getMeasurement(point, 1) > 0.) {
+            m_parameters.push_back(m_planes.size());
+            m_planes.push_back(pl);
+            m_points.push_back(point);
+            m_projections.push_back(tel.getProjection(pl));
+        }
+    }
+    LOG(DEBUG) << "Fitting resolutions of " << m_planes.size() << " measurement planes";
+}
+
+void residualfit::tie(const std::vector<size_t>& planes) {
+    std::vector<size_t> members;
+    for(const auto& pl : planes) {
+        auto it = std::find(m_planes.begin(), m_planes.end(), pl);
+        if(it == m_planes.end()) {
+            LOG(ERROR) << "Plane " << pl << " has no measurement, cannot tie its resolution";
+            continue;
+        }
+        members.push_back(static_cast<size_t>(std::distance(m_planes.begin(), it)));
+    }
+    if(members.empty()) {
+        return;
+    }
+
+    // Merge the parameters of all members into the first one and renumber them consecutively:
+    auto target = m_parameters.at(members.front());
+    for(const auto& member : members) {
+        auto source = m_parameters.at(member);
+        std::replace(m_parameters.begin(), m_parameters.end(), source, target);
+    }
+    std::vector<size_t> ids = m_parameters;
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    for(auto& parameter : m_parameters) {
+        parameter = static_cast<size_t>(std::distance(ids.begin(), std::lower_bound(ids.begin(), ids.end(), parameter)));
+    }
+}
+
+std::vector<std::pair<double, double>> residualfit::fit(const std::vector<residual>& measured, bool unbiased) {
+    auto x = fit(measured, unbiased, 0);
+    auto y = fit(measured, unbiased, 1);
+
+    std::vector<std::pair<double, double>> resolutions(m_numberOfPlanes, {0., 0.});
+    for(size_t k = 0; k < m_planes.size(); k++) {
+        // Intrinsic resolutions along the measurement axes:
+        resolutions.at(m_planes.at(k)) = {x.at(k) * m_projections.at(k).first, y.at(k) * m_projections.at(k).second};
+    }
+    return resolutions;
+}
+
+std::vector<double> residualfit::fit(const std::vector<residual>& measured, bool unbiased, size_t axis) {
+
+    if(m_planes.empty()) {
+        return {};
+    }
+
+    // Measured widths in [mm] in the beam frame with the measurement plane they belong to:
+    std::vector<std::pair<size_t, double>> data;
+    for(const auto& res : measured) {
+        auto it = std::find(m_planes.begin(), m_planes.end(), res.plane);
+        if(it == m_planes.end()) {
+            LOG(WARNING) << "Plane " << res.plane << " has no measurement, ignoring its residual width";
+            continue;
+        }
+        auto k = static_cast<size_t>(std::distance(m_planes.begin(), it));
+        auto width = unbiased ? res.unbiased : res.biased;
+        auto projection = (axis == 0 ? m_projections[k].first : m_projections[k].second);
+        data.emplace_back(k, (axis == 0 ? width.first : width.second) * 1E-3 / projection);
+    }
+
+    auto n_planes = m_planes.size();
+    auto n_par = static_cast<Eigen::Index>(*std::max_element(m_parameters.begin(), m_parameters.end()) + 1);
+
+    // Start from the mean logarithm of the current resolutions of each parameter group:
+    Eigen::VectorXd par = Eigen::VectorXd::Zero(n_par);
+    Eigen::VectorXd count = Eigen::VectorXd::Zero(n_par);
+    for(size_t k = 0; k < n_planes; k++) {
+        auto p = static_cast<Eigen::Index>(m_parameters[k]);
+        par(p) -= 0.5 * log(m_chain.getMeasurement(m_points[k], axis));
+        count(p) += 1.;
+    }
+    par = par.cwiseQuotient(count);
+
+    // Relative deviation of predicted and measured widths and its Jacobian with respect to the parameters:
+    auto n_data = static_cast<Eigen::Index>(data.size());
+    auto evaluate = [&](const Eigen::VectorXd& parameters, Eigen::VectorXd& deviation, Eigen::MatrixXd& jacobian) {
+        std::vector<double> sigma(n_planes);
+        for(size_t k = 0; k < n_planes; k++) {
+            sigma[k] = exp(parameters(static_cast<Eigen::Index>(m_parameters[k])));
+            m_chain.setMeasurement(m_points[k], axis, 1. / sigma[k] / sigma[k]);
+        }
+
+        smoother fitter(m_chain, axis);
+        auto cov = fitter.getCovariance(m_points);
+
+        deviation.resize(n_data);
+        jacobian.setZero(n_data, n_par);
+        for(Eigen::Index d = 0; d < n_data; d++) {
+            auto k = data[static_cast<size_t>(d)].first;
+            auto meas = data[static_cast<size_t>(d)].second;
+            auto kk = static_cast<Eigen::Index>(2 * k);
+
+            // Biased width b^2 = s_k^2 - V_kk, unbiased width u = s_k^2 / b:
+            double biased = sqrt(std::max(sigma[k] * sigma[k] - cov(kk, kk), 1e-24));
+            deviation(d) = (unbiased ? sigma[k] * sigma[k] / biased : biased) / meas - 1.;
+
+            for(size_t j = 0; j < n_planes; j++) {
+                auto vkj = cov(kk, static_cast<Eigen::Index>(2 * j));
+                double delta = (j == k ? 1. : 0.);
+                // dV_kk/ds_j = 2 V_kj^2 / s_j^3
+                double dbiased = (sigma[k] * delta - vkj * vkj / (sigma[j] * sigma[j] * sigma[j])) / biased;
+                double dpred =
+                    unbiased ? 2. * sigma[k] * delta / biased - sigma[k] * sigma[k] / biased / biased * dbiased : dbiased;
+                // Chain rule for the logarithmic parameters, ds_j/dp = s_j:
+                jacobian(d, static_cast<Eigen::Index>(m_parameters[j])) += dpred * sigma[j] / meas;
+            }
+        }
+        return deviation.squaredNorm();
+    };
+
+    Eigen::VectorXd deviation;
+    Eigen::MatrixXd jacobian;
+    double chi2 = evaluate(par, deviation, jacobian);
+
+    // Levenberg-Marquardt iteration:
+    double lambda = 1e-3;
+    unsigned int iteration = 0;
+    for(; iteration < 100; iteration++) {
+        // Normal matrix and gradient of the squared deviations:
+        Eigen::MatrixXd normal = Eigen::MatrixXd::Zero(n_par, n_par);
+        Eigen::VectorXd gradient = Eigen::VectorXd::Zero(n_par);
+        for(size_t d = 0; d < data.size(); d++) {
+            auto row = static_cast<Eigen::Index>(d);
+            for(size_t i = 0; i < static_cast<size_t>(n_par); i++) {
+                auto ri = static_cast<Eigen::Index>(i);
+                gradient(ri) += jacobian(row, ri) * deviation(row);
+                for(size_t j = 0; j <= i; j++) {
+                    auto rj = static_cast<Eigen::Index>(j);
+                    normal(ri, rj) += jacobian(row, ri) * jacobian(row, rj);
+                }
+            }
+        }
+
+        bool accepted = false;
+        Eigen::VectorXd step;
+        while(lambda < 1e10) {
+            Eigen::MatrixXd damped = normal;
+            damped.diagonal() += lambda * normal.diagonal() + Eigen::VectorXd::Constant(n_par, 1e-12);
+            cholesky decomposition(damped);
+            if(!decomposition.isPositiveDefinite()) {
+                lambda *= 10.;
+                continue;
+            }
+            step = -decomposition.solve(gradient);
+
+            Eigen::VectorXd trial_deviation;
+            Eigen::MatrixXd trial_jacobian;
+            double trial = evaluate(par + step, trial_deviation, trial_jacobian);
+            if(trial <= chi2) {
+                par += step;
+                deviation = trial_deviation;
+                jacobian = trial_jacobian;
+                accepted = (chi2 - trial > 1e-14 * chi2 && step.norm() > 1e-10);
+                chi2 = trial;
+                lambda = std::max(lambda * 0.1, 1e-12);
+                break;
+            }
+            lambda *= 10.;
+        }
+        LOG(TRACE) << "Iteration " << iteration << ": chi2 = " << chi2 << ", lambda = " << lambda;
+        if(!accepted) {
+            break;
+        }
+    }
+
+    // Leave the chain at the fitted resolutions:
+    std::vector<double> resolutions(n_planes);
+    for(size_t k = 0; k < n_planes; k++) {
+        resolutions[k] = exp(par(static_cast<Eigen::Index>(m_parameters[k])));
+        m_chain.setMeasurement(m_points[k], axis, 1. / resolutions[k] / resolutions[k]);
+    }
+
+    (axis == 0 ? m_iterations.first : m_iterations.second) = iteration + 1;
+    (axis == 0 ? m_chi2.first : m_chi2.second) = chi2;
+    LOG(DEBUG) << "Resolution fit converged after " << iteration + 1 << " iterations, chi2 = " << chi2;
+    return resolutions;
+}
@@ -0,0 +1,51 @@
+#ifndef RESIDUALFIT_H
+#define RESIDUALFIT_H
+
+#include <utility>
+#include <vector>
+
+#include "assembly.h"
+
+namespace gblsim {
+
+    // Fit of the intrinsic resolutions of the measurement planes to measured residual widths.
+    // The predicted widths and their analytic derivatives with respect to the resolutions are obtained from the smoothed
+    // position cross-covariances of the telescope chain, dV_ii/dw_j = -V_ij^2 for a measurement precision w_j. Both axes
+    // are fitted independently with a damped Gauss-Newton iteration in the logarithm of the resolutions. The fit runs in
+    // the beam frame of the chain, widths and resolutions of tilted planes are projected on their measurement axes.
+    class residualfit {
+    public:
+        // Fit the planes of the given telescope, its plane resolutions serve as starting values
+        explicit residualfit(const telescope& tel);
+
+        // Use a common resolution for all given planes
+        void tie(const std::vector<size_t>& planes);
+
+        // Fit the resolutions to measured biased or unbiased residual widths in [um], returns the resolution of every
+        // plane in [mm] for both dimensions, planes without measurement are returned as zero
+        std::vector<std::pair<double, double>> fit(const std::vector<residual>& measured, bool unbiased);
+
+        // Return the number of iterations and the sum of squared relative width deviations of the last fit per dimension
+        std::pair<unsigned int, unsigned int> getIterations() const { return m_iterations; }
+        std::pair<double, double> getChi2() const { return m_chi2; }
+
+    private:
+        // Fit one dimension, returns the resolution of every measurement plane in the beam frame
+        std::vector<double> fit(const std::vector<residual>& measured, bool unbiased, size_t axis);
+
+        chain m_chain;
+        size_t m_numberOfPlanes;
+        // Chain point and fit parameter of every measurement plane:
+        std::vector<size_t> m_planes;
+        std::vector<size_t> m_points;
+        std::vector<size_t> m_parameters;
+        // Projection from the beam frame on the measurement axes of every measurement plane:
+        std::vector<std::pair<double, double>> m_projections;
+
+        std::pair<unsigned int, unsigned int> m_iterations;
+        std::pair<double, double> m_chi2;
+    };
+
+} // namespace gblsim
+
+#endif /* RESIDUALFIT_H */
@@ -0,0 +1,333 @@
+#include "scanfile.h"
+
+#include "log.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace gblsim;
+using namespace unilog;
+
+namespace {
+    const char header_magic[] = "TRSCAN01";
+    const char chunk_magic[] = "CHNK";
+    const char footer_magic[] = "TRSINDEX";
+
+    // Size of the chunk header, magic plus padding and number of rows:
+    const uint64_t chunk_header = 16;
+
+    uint64_t padding(uint64_t offset) { return (8 - offset % 8) % 8; }
+
+    template <typename T> T read(const char* data, uint64_t offset) {
+        T value;
+        std::memcpy(&value, data + offset, sizeof(T));
+        return value;
+    }
+} // namespace
+
+scanwriter::scanwriter(const std::string& path, std::vector<std::string> columns, size_t chunk_rows)
+    : m_file(std::fopen(path.c_str(), "wb")), m_columns(std::move(columns)), m_chunkRows(chunk_rows), m_offset(0),
+      m_buffer(m_columns.size() * chunk_rows), m_rows(0) {
+    if(m_file == nullptr) {
+        throw std::runtime_error("Could not open scan file " + path + " for writing");
+    }
+
+    uint64_t n_columns = m_columns.size(), n_rows = m_chunkRows;
+    write(header_magic, 8);
+    write(&n_columns, sizeof(n_columns));
+    write(&n_rows, sizeof(n_rows));
+    for(const auto& column : m_columns) {
+        uint64_t length = column.size();
+        write(&length, sizeof(length));
+        write(column.data(), length);
+        const char zeros[8] = {};
+        write(zeros, padding(m_offset));
+    }
+    LOG(DEBUG) << "Opened scan file " << path << " with " << m_columns.size() << " columns";
+}
+
+scanwriter::~scanwriter() {
+    try {
+        close();
+    } catch(std::runtime_error& e) {
+        LOG(ERROR) << e.what();
+    }
+}
+
+void scanwriter::write(const void* data, uint64_t size) {
+    if(std::fwrite(data, 1, size, m_file) != size) {
+        std::fclose(m_file);
+        m_file = nullptr;
+        throw std::runtime_error("Could not write scan file");
+    }
+    m_offset += size;
+}
+
+void scanwriter::fill(const std::vector<double>& row) {
+    if(row.size() != m_columns.size()) {
+        throw std::invalid_argument("Scan file row has " + std::to_string(row.size()) + " values but " +
+                                    std::to_string(m_columns.size()) + " columns are defined");
+    }
+    for(size_t column = 0; column < m_columns.size(); column++) {
+        m_buffer[column * m_chunkRows + m_rows] = row[column];
+    }
+    if(++m_rows == m_chunkRows) {
+        writeChunk();
+    }
+}
+
+void scanwriter::writeChunk() {
+    if(m_rows == 0 || m_file == nullptr) {
+        return;
+    }
+
+    m_chunkOffsets.push_back(m_offset);
+    m_chunkSizes.push_back(m_rows);
+
+    uint32_t pad = 0;
+    uint64_t rows = m_rows;
+    m_rows = 0;
+    write(chunk_magic, 4);
+    write(&pad, sizeof(pad));
+    write(&rows, sizeof(rows));
+    for(size_t column = 0; column < m_columns.size(); column++) {
+        const double* values = m_buffer.data() + column * m_chunkRows;
+        write(values, sizeof(double) * rows);
+        auto range = std::minmax_element(values, values + rows);
+        m_chunkRanges.emplace_back(*range.first, *range.second);
+    }
+
+    // Make the chunk available to readers right away:
+    if(std::fflush(m_file) != 0) {
+        std::fclose(m_file);
+        m_file = nullptr;
+        throw std::runtime_error("Could not write scan file");
+    }
+}
+
+void scanwriter::close() {
+    if(m_file == nullptr) {
+        return;
+    }
+    writeChunk();
+
+    uint64_t footer = m_offset;
+    for(size_t chunk = 0; chunk < m_chunkOffsets.size(); chunk++) {
+        write(&m_chunkOffsets[chunk], sizeof(uint64_t));
+        write(&m_chunkSizes[chunk], sizeof(uint64_t));
+        for(size_t column = 0; column < m_columns.size(); column++) {
+            const auto& range = m_chunkRanges[chunk * m_columns.size() + column];
+            write(&range.first, sizeof(double));
+            write(&range.second, sizeof(double));
+        }
+    }
+    uint64_t chunks = m_chunkOffsets.size();
+    write(&chunks, sizeof(chunks));
+    write(&footer, sizeof(footer));
+    write(footer_magic, 8);
+
+    bool failed = (std::ferror(m_file) != 0);
+    failed |= (std::fclose(m_file) != 0);
+    m_file = nullptr;
+    if(failed) {
+        throw std::runtime_error("Could not write scan file");
+    }
+    LOG(DEBUG) << "Closed scan file with " << chunks << " chunks";
+}
+
+scanreader::scanreader(const std::string& path) : m_data(nullptr), m_size(0), m_rows(0) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0) {
+        throw std::runtime_error("Could not open scan file " + path);
+    }
+    struct stat info;
+    if(::fstat(fd, &info) != 0 || info.st_size < 24) {
+        ::close(fd);
+        throw std::runtime_error("Scan file " + path + " is not valid");
+    }
+    m_size = static_cast<size_t>(info.st_size);
+    void* mapping = ::mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if(mapping == MAP_FAILED) {
+        throw std::runtime_error("Could not map scan file " + path);
+    }
+    m_data = static_cast<const char*>(mapping);
+
+    // The destructor does not run if the constructor throws:
+    try {
+        auto offset = readHeader(path);
+        bool indexed = false;
+        if(std::memcmp(m_data + m_size - 8, footer_magic, 8) == 0) {
+            indexed = readIndex(offset, read<uint64_t>(m_data, m_size - 16), read<uint64_t>(m_data, m_size - 24));
+            if(!indexed) {
+                LOG(WARNING) << "Scan file " << path << " has a corrupt index, recovering complete chunks";
+            }
+        } else {
+            LOG(WARNING) << "Scan file " << path << " has no index, recovering complete chunks";
+        }
+        if(!indexed) {
+            recoverIndex(offset);
+        }
+    } catch(...) {
+        ::munmap(mapping, m_size);
+        m_data = nullptr;
+        throw;
+    }
+    LOG(DEBUG) << "Mapped scan file " << path << " with " << m_rows << " rows in " << getChunks() << " chunks";
+}
+
+scanreader::~scanreader() {
+    if(m_data != nullptr) {
+        ::munmap(const_cast<char*>(m_data), m_size);
+    }
+}
+
+uint64_t scanreader::readHeader(const std::string& path) {
+    if(std::memcmp(m_data, header_magic, 8) != 0) {
+        throw std::runtime_error("Scan file " + path + " has no valid header");
+    }
+    // Every column takes at least the 8 bytes of its name length:
+    auto n_columns = read<uint64_t>(m_data, 8);
+    uint64_t offset = 24;
+    if(n_columns > (m_size - offset) / 8) {
+        throw std::runtime_error("Scan file " + path + " has a corrupt header");
+    }
+    for(uint64_t column = 0; column < n_columns; column++) {
+        if(offset + 8 > m_size) {
+            throw std::runtime_error("Scan file " + path + " has a corrupt header");
+        }
+        auto length = read<uint64_t>(m_data, offset);
+        if(length > m_size - offset - 8) {
+            throw std::runtime_error("Scan file " + path + " has a corrupt header");
+        }
+        m_columns.emplace_back(m_data + offset + 8, length);
+        offset += 8 + length;
+        offset += padding(offset);
+    }
+    return std::min<uint64_t>(offset, m_size);
+}
+
+bool scanreader::readIndex(uint64_t begin, uint64_t footer, uint64_t chunks) {
+    // The footer lies between the header and its trailer of 24 bytes, with one entry per chunk:
+    const uint64_t entry = 16 + 16 * m_columns.size();
+    const uint64_t trailer = m_size - 24;
+    if(footer < begin || footer > trailer || chunks > (trailer - footer) / entry) {
+        return false;
+    }
+
+    uint64_t offset = footer;
+    for(uint64_t chunk = 0; chunk < chunks; chunk++) {
+        auto chunk_offset = read<uint64_t>(m_data, offset);
+        auto rows = read<uint64_t>(m_data, offset + 8);
+        // Chunks have to lie completely between the header and the footer:
+        if(chunk_offset < begin || chunk_offset > footer || footer - chunk_offset < chunk_header ||
+           (!m_columns.empty() && rows > (footer - chunk_offset - chunk_header) / (8 * m_columns.size())) ||
+           std::memcmp(m_data + chunk_offset, chunk_magic, 4) != 0) {
+            m_chunkOffsets.clear();
+            m_chunkSizes.clear();
+            m_chunkBegins.clear();
+            m_chunkRanges.clear();
+            m_rows = 0;
+            return false;
+        }
+        m_chunkOffsets.push_back(chunk_offset);
+        m_chunkSizes.push_back(rows);
+        m_chunkBegins.push_back(m_rows);
+        m_rows += rows;
+        offset += 16;
+        for(size_t column = 0; column < m_columns.size(); column++) {
+            m_chunkRanges.emplace_back(read<double>(m_data, offset), read<double>(m_data, offset + 8));
+            offset += 16;
+        }
+    }
+    return true;
+}
+
+void scanreader::recoverIndex(uint64_t offset) {
+    while(offset + chunk_header <= m_size && std::memcmp(m_data + offset, chunk_magic, 4) == 0) {
+        auto rows = read<uint64_t>(m_data, offset + 8);
+        if(!m_columns.empty() && rows > (m_size - offset - chunk_header) / (8 * m_columns.size())) {
+            break;
+        }
+        uint64_t size = chunk_header + m_columns.size() * rows * sizeof(double);
+        m_chunkOffsets.push_back(offset);
+        m_chunkSizes.push_back(rows);
+        m_chunkBegins.push_back(m_rows);
+        m_rows += rows;
+        for(size_t column = 0; column < m_columns.size(); column++) {
+            const double* values = getData(m_chunkOffsets.size() - 1, column);
+            auto range = std::minmax_element(values, values + rows);
+            m_chunkRanges.emplace_back(*range.first, *range.second);
+        }
+        offset += size;
+    }
+}
+
+size_t scanreader::getColumn(const std::string& name) const {
+    auto it = std::find(m_columns.begin(), m_columns.end(), name);
+    if(it == m_columns.end()) {
+        throw std::invalid_argument("Scan file has no column " + name);
+    }
+    return static_cast<size_t>(std::distance(m_columns.begin(), it));
+}
+
+const double* scanreader::getData(size_t chunk, size_t column) const {
+    checkColumn(column);
+    return reinterpret_cast<const double*>(m_data + m_chunkOffsets.at(chunk) + chunk_header +
+                                           column * m_chunkSizes.at(chunk) * sizeof(double));
+}
+
+double scanreader::getValue(uint64_t row, size_t column) const {
+    if(row >= m_rows) {
+        throw std::out_of_range("Scan file has no row " + std::to_string(row) + ", it has " + std::to_string(m_rows));
+    }
+    auto chunk = static_cast<size_t>(std::upper_bound(m_chunkBegins.begin(), m_chunkBegins.end(), row) -
+                                     m_chunkBegins.begin() - 1);
+    return getData(chunk, column)[row - m_chunkBegins[chunk]];
+}
+
+void scanreader::checkColumn(size_t column) const {
+    if(column >= m_columns.size()) {
+        throw std::out_of_range("Scan file has no column " + std::to_string(column) + ", it has " +
+                                std::to_string(m_columns.size()));
+    }
+}
+
+std::vector<std::pair<uint64_t, uint64_t>> scanreader::select(size_t column, double min, double max) const {
+    checkColumn(column);
+    std::vector<std::pair<uint64_t, uint64_t>> ranges;
+    auto add = [&](uint64_t first, uint64_t last) {
+        if(!ranges.empty() && ranges.back().second == first) {
+            ranges.back().second = last;
+        } else {
+            ranges.emplace_back(first, last);
+        }
+    };
+
+    for(size_t chunk = 0; chunk < getChunks(); chunk++) {
+        const auto& range = m_chunkRanges[chunk * m_columns.size() + column];
+        auto begin = m_chunkBegins[chunk];
+        if(range.second < min || range.first > max) {
+            continue;
+        }
+        if(range.first >= min && range.second <= max) {
+            add(begin, begin + m_chunkSizes[chunk]);
+            continue;
+        }
+
+        const double* values = getData(chunk, column);
+        for(uint64_t row = 0; row < m_chunkSizes[chunk]; row++) {
+            if(values[row] >= min && values[row] <= max) {
+                add(begin + row, begin + row + 1);
+            }
+        }
+    }
+    return ranges;
+}
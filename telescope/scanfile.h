@@ -0,0 +1,107 @@
+#ifndef SCANFILE_H
+#define SCANFILE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace gblsim {
+
+    // Columnar binary file for scan results with one column of doubles per scan parameter and result.
+    //
+    // Layout (native byte order, all sections aligned to 8 bytes):
+    //   header:  magic "TRSCAN01", number of columns, chunk size, column names
+    //   chunks:  magic "CHNK", number of rows, then the values of each column for these rows, column after column
+    //   footer:  per chunk its offset, number of rows and the minimum and maximum of every column,
+    //            followed by the number of chunks, the footer offset and the magic "TRSINDEX"
+    //
+    // Chunks are appended as soon as they are full and flushed to disk, the footer is written when the file is closed.
+    // Files without footer, e.g. from jobs which have been killed, can still be read by walking the chunk headers.
+    class scanwriter {
+    public:
+        scanwriter(const std::string& path, std::vector<std::string> columns, size_t chunk_rows = 65536);
+        ~scanwriter();
+
+        scanwriter(const scanwriter&) = delete;
+        scanwriter& operator=(const scanwriter&) = delete;
+
+        // Append one row with a value for every column
+        void fill(const std::vector<double>& row);
+        // Write the pending chunk and the footer index and close the file, throws if the file could not be written
+        void close();
+
+    private:
+        void writeChunk();
+        // Write to the file, closes the file and throws on failure
+        void write(const void* data, uint64_t size);
+
+        std::FILE* m_file;
+        std::vector<std::string> m_columns;
+        size_t m_chunkRows;
+        uint64_t m_offset;
+
+        // Values of the pending chunk, column after column:
+        std::vector<double> m_buffer;
+        size_t m_rows;
+
+        // Index of all written chunks as offset, rows and (minimum, maximum) of every column:
+        std::vector<uint64_t> m_chunkOffsets;
+        std::vector<uint64_t> m_chunkSizes;
+        std::vector<std::pair<double, double>> m_chunkRanges;
+    };
+
+    // Read-only access to a scan file through a memory mapping, column data are returned without copy. All sizes and
+    // offsets read from the file are checked against its size, a file with corrupt index is read by walking the chunks
+    class scanreader {
+    public:
+        explicit scanreader(const std::string& path);
+        ~scanreader();
+
+        scanreader(const scanreader&) = delete;
+        scanreader& operator=(const scanreader&) = delete;
+
+        const std::vector<std::string>& getColumns() const { return m_columns; }
+        // Return the index of the column with the given name
+        size_t getColumn(const std::string& name) const;
+
+        uint64_t getRows() const { return m_rows; }
+        size_t getChunks() const { return m_chunkOffsets.size(); }
+        uint64_t getChunkRows(size_t chunk) const { return m_chunkSizes.at(chunk); }
+        // Return the first row of the given chunk
+        uint64_t getChunkBegin(size_t chunk) const { return m_chunkBegins.at(chunk); }
+
+        // The accessors below throw std::out_of_range for chunks, rows or columns not in the file.
+        // Return the values of a column within one chunk, pointing directly into the mapped file
+        const double* getData(size_t chunk, size_t column) const;
+        // Return a single value
+        double getValue(uint64_t row, size_t column) const;
+
+        // Return all row ranges [first, last) in which the column lies within [min, max]. Chunks are skipped based on the
+        // index without touching their data
+        std::vector<std::pair<uint64_t, uint64_t>> select(size_t column, double min, double max) const;
+
+    private:
+        // Read the header with the column names, return the offset behind it
+        uint64_t readHeader(const std::string& path);
+        // Read the footer index, return false if it is not consistent with the file
+        bool readIndex(uint64_t begin, uint64_t footer, uint64_t chunks);
+        void recoverIndex(uint64_t offset);
+        // Throw if the column is not in the file
+        void checkColumn(size_t column) const;
+
+        const char* m_data;
+        size_t m_size;
+
+        std::vector<std::string> m_columns;
+        uint64_t m_rows;
+        std::vector<uint64_t> m_chunkOffsets;
+        std::vector<uint64_t> m_chunkSizes;
+        std::vector<uint64_t> m_chunkBegins;
+        std::vector<std::pair<double, double>> m_chunkRanges;
+    };
+
+} // namespace gblsim
+
+#endif /* SCANFILE_H */
@@ -0,0 +1,312 @@
+#include "scanspace.h"
+
+#include "log.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+using namespace gblsim;
+using namespace unilog;
+
+class scanspace::node {
+public:
+    virtual ~node() = default;
+    virtual uint64_t size() const = 0;
+    virtual size_t dimensions() const = 0;
+    // Write the coordinates of the given point starting at the given position, false if rejected by a filter
+    virtual bool get(uint64_t index, std::vector<double>& point, size_t offset) const = 0;
+};
+
+namespace {
+    class rangenode : public scanspace::node {
+    public:
+        rangenode(double first, double last, uint64_t points) : m_first(first), m_last(last), m_points(points) {}
+        uint64_t size() const override { return m_points; }
+        size_t dimensions() const override { return 1; }
+        bool get(uint64_t index, std::vector<double>& point, size_t offset) const override {
+            point[offset] = (m_points > 1) ? m_first + (m_last - m_first) * static_cast<double>(index) /
+                                                           static_cast<double>(m_points - 1)
+                                           : m_first;
+            return true;
+        }
+
+    private:
+        double m_first;
+        double m_last;
+        uint64_t m_points;
+    };
+
+    class valuenode : public scanspace::node {
+    public:
+        explicit valuenode(std::vector<double> values) : m_values(std::move(values)) {}
+        uint64_t size() const override { return m_values.size(); }
+        size_t dimensions() const override { return 1; }
+        bool get(uint64_t index, std::vector<double>& point, size_t offset) const override {
+            point[offset] = m_values[index];
+            return true;
+        }
+
+    private:
+        std::vector<double> m_values;
+    };
+
+    class productnode : public scanspace::node {
+    public:
+        productnode(std::shared_ptr<const node> a, std::shared_ptr<const node> b) : m_a(std::move(a)), m_b(std::move(b)) {
+            if(m_b->size() > 0 && m_a->size() > std::numeric_limits<uint64_t>::max() / m_b->size()) {
+                throw std::length_error("scan space exceeds the index range");
+            }
+        }
+        uint64_t size() const override { return m_a->size() * m_b->size(); }
+        size_t dimensions() const override { return m_a->dimensions() + m_b->dimensions(); }
+        bool get(uint64_t index, std::vector<double>& point, size_t offset) const override {
+            auto inner = m_b->size();
+            return m_a->get(index / inner, point, offset) && m_b->get(index % inner, point, offset + m_a->dimensions());
+        }
+
+    private:
+        std::shared_ptr<const node> m_a;
+        std::shared_ptr<const node> m_b;
+    };
+
+    class zipnode : public scanspace::node {
+    public:
+        zipnode(std::shared_ptr<const node> a, std::shared_ptr<const node> b) : m_a(std::move(a)), m_b(std::move(b)) {}
+        uint64_t size() const override { return std::min(m_a->size(), m_b->size()); }
+        size_t dimensions() const override { return m_a->dimensions() + m_b->dimensions(); }
+        bool get(uint64_t index, std::vector<double>& point, size_t offset) const override {
+            return m_a->get(index, point, offset) && m_b->get(index, point, offset + m_a->dimensions());
+        }
+
+    private:
+        std::shared_ptr<const node> m_a;
+        std::shared_ptr<const node> m_b;
+    };
+
+    class filternode : public scanspace::node {
+    public:
+        filternode(std::shared_ptr<const node> space, std::function<bool(const std::vector<double>&)> predicate)
+            : m_space(std::move(space)), m_predicate(std::move(predicate)) {}
+        uint64_t size() const override { return m_space->size(); }
+        size_t dimensions() const override { return m_space->dimensions(); }
+        bool get(uint64_t index, std::vector<double>& point, size_t offset) const override {
+            if(!m_space->get(index, point, offset)) {
+                return false;
+            }
+            // The predicate sees the coordinates of this space only:
+            if(offset == 0 && point.size() == dimensions()) {
+                return m_predicate(point);
+            }
+            std::vector<double> own(point.begin() + static_cast<std::ptrdiff_t>(offset),
+                                    point.begin() + static_cast<std::ptrdiff_t>(offset + dimensions()));
+            return m_predicate(own);
+        }
+
+    private:
+        std::shared_ptr<const node> m_space;
+        std::function<bool(const std::vector<double>&)> m_predicate;
+    };
+} // namespace
+
+scanspace scanspace::range(double first, double last, uint64_t points) {
+    return scanspace(std::make_shared<rangenode>(first, last, points));
+}
+
+scanspace scanspace::values(std::vector<double> values) {
+    return scanspace(std::make_shared<valuenode>(std::move(values)));
+}
+
+scanspace scanspace::product(const scanspace& a, const scanspace& b) {
+    return scanspace(std::make_shared<productnode>(a.m_node, b.m_node));
+}
+
+scanspace scanspace::zip(const scanspace& a, const scanspace& b) {
+    return scanspace(std::make_shared<zipnode>(a.m_node, b.m_node));
+}
+
+scanspace scanspace::filter(std::function<bool(const std::vector<double>&)> predicate) const {
+    return scanspace(std::make_shared<filternode>(m_node, std::move(predicate)));
+}
+
+uint64_t scanspace::size() const {
+    return m_node->size();
+}
+
+size_t scanspace::dimensions() const {
+    return m_node->dimensions();
+}
+
+bool scanspace::get(uint64_t index, std::vector<double>& point) const {
+    point.resize(dimensions());
+    return m_node->get(index, point, 0);
+}
+
+topsink::topsink(size_t count, size_t column, bool largest) : m_count(count), m_column(column), m_largest(largest) {}
+
+bool topsink::better(const scanresult& a, const scanresult& b) const {
+    double va = a.values.at(m_column);
+    double vb = b.values.at(m_column);
+    if(va != vb) {
+        return m_largest ? va > vb : va < vb;
+    }
+    return a.index < b.index;
+}
+
+void topsink::consume(scanresult result) {
+    // The heap is maintained by hand with unsigned indices, the worst result sits on top:
+    if(m_heap.size() < m_count) {
+        auto i = m_heap.size();
+        m_heap.push_back(std::move(result));
+        while(i > 0) {
+            auto parent = (i - 1) / 2;
+            if(!better(m_heap[parent], m_heap[i])) {
+                break;
+            }
+            std::swap(m_heap[parent], m_heap[i]);
+            i = parent;
+        }
+    } else if(m_count > 0 && better(result, m_heap.front())) {
+        // Replace the worst result and sift the new one down:
+        m_heap.front() = std::move(result);
+        size_t i = 0;
+        while(true) {
+            auto worst = i;
+            for(auto child = 2 * i + 1; child < 2 * i + 3 && child < m_heap.size(); child++) {
+                worst = better(m_heap[worst], m_heap[child]) ? child : worst;
+            }
+            if(worst == i) {
+                break;
+            }
+            std::swap(m_heap[worst], m_heap[i]);
+            i = worst;
+        }
+    }
+}
+
+std::vector<scanresult> topsink::getResults() const {
+    auto results = m_heap;
+    std::sort(results.begin(), results.end(), [this](const scanresult& a, const scanresult& b) { return better(a, b); });
+    return results;
+}
+
+thresholdsink::thresholdsink(size_t column, double threshold, bool above)
+    : m_column(column), m_threshold(threshold), m_above(above) {}
+
+void thresholdsink::consume(scanresult result) {
+    double value = result.values.at(m_column);
+    if(m_above ? value > m_threshold : value < m_threshold) {
+        m_results.push_back(std::move(result));
+    }
+}
+
+std::vector<scanresult> thresholdsink::getResults() const {
+    auto results = m_results;
+    std::sort(results.begin(), results.end(), [](const scanresult& a, const scanresult& b) { return a.index < b.index; });
+    return results;
+}
+
+void filesink::consume(scanresult result) {
+    result.point.insert(result.point.end(), result.values.begin(), result.values.end());
+    m_writer.fill(result.point);
+}
+
+scanpipeline::scanpipeline(evaluator evaluate, size_t threads, size_t queue)
+    : m_evaluate(std::move(evaluate)), m_threads(threads > 0 ? threads : std::max(std::thread::hardware_concurrency(), 1u)),
+      m_queue(std::max(queue, size_t(1))) {}
+
+uint64_t scanpipeline::run(const scanspace& space, scansink& sink) const {
+
+    // Blocks of indices claimed by the workers at once:
+    const uint64_t block = 64;
+    std::atomic<uint64_t> next(0);
+    std::atomic<bool> abort(false);
+
+    std::mutex mutex;
+    std::condition_variable produced;
+    std::condition_variable consumed;
+    std::deque<scanresult> queue;
+    size_t running = m_threads;
+    std::exception_ptr error;
+
+    // Logging settings are per thread and have to be passed on to the workers:
+    auto level = Log::getReportingLevel();
+    auto format = Log::getFormat();
+    auto work = [&]() {
+        Log::setReportingLevel(level);
+        Log::setFormat(format);
+        std::vector<double> point;
+        try {
+            for(uint64_t first = next.fetch_add(block); first < space.size() && !abort; first = next.fetch_add(block)) {
+                for(uint64_t index = first; index < std::min(first + block, space.size()) && !abort; index++) {
+                    if(!space.get(index, point)) {
+                        continue;
+                    }
+                    scanresult result{index, point, m_evaluate(point)};
+
+                    std::unique_lock<std::mutex> lock(mutex);
+                    consumed.wait(lock, [&]() { return queue.size() < m_queue || abort; });
+                    queue.push_back(std::move(result));
+                    produced.notify_one();
+                }
+            }
+        } catch(...) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if(!error) {
+                error = std::current_exception();
+            }
+            abort = true;
+            consumed.notify_all();
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        running--;
+        produced.notify_one();
+    };
+
+    std::vector<std::thread> workers;
+    for(size_t t = 0; t < m_threads; t++) {
+        workers.emplace_back(work);
+    }
+
+    // Drain the queue into the sink until all workers are done, results are counted once the sink took them:
+    uint64_t evaluated = 0;
+    while(true) {
+        std::unique_lock<std::mutex> lock(mutex);
+        produced.wait(lock, [&]() { return !queue.empty() || running == 0; });
+        if(queue.empty()) {
+            break;
+        }
+        auto result = std::move(queue.front());
+        queue.pop_front();
+        consumed.notify_one();
+        lock.unlock();
+
+        if(!abort) {
+            try {
+                sink.consume(std::move(result));
+                evaluated++;
+            } catch(...) {
+                std::lock_guard<std::mutex> guard(mutex);
+                error = std::current_exception();
+                abort = true;
+                consumed.notify_all();
+            }
+        }
+    }
+
+    for(auto& worker : workers) {
+        worker.join();
+    }
+    if(error) {
+        std::rethrow_exception(error);
+    }
+
+    LOG(DEBUG) << "Evaluated " << evaluated << " of " << space.size() << " scan points";
+    return evaluated;
+}
@@ -0,0 +1,130 @@
+#ifndef SCANSPACE_H
+#define SCANSPACE_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "scanfile.h"
+
+namespace gblsim {
+
+    // Space of scan points which are generated on demand from their index, so arbitrarily large spaces take no memory.
+    // Spaces are built from one-dimensional ranges or value lists, combined as Cartesian products or zipped side by side
+    // and restricted by predicates. Copies share the underlying description.
+    class scanspace {
+    public:
+        // Equidistant points from first to last, both included
+        static scanspace range(double first, double last, uint64_t points);
+        // Explicit list of values
+        static scanspace values(std::vector<double> values);
+        // Cartesian product of two spaces, the points of the second space vary fastest
+        static scanspace product(const scanspace& a, const scanspace& b);
+        // Points of two spaces side by side, truncated to the shorter space
+        static scanspace zip(const scanspace& a, const scanspace& b);
+        // Subspace of the points for which the predicate holds. The predicate is called concurrently from the worker
+        // threads of a scanpipeline and has to be thread-safe
+        scanspace filter(std::function<bool(const std::vector<double>&)> predicate) const;
+
+        // Return the number of candidate points, including those rejected by filters, and the number of coordinates
+        uint64_t size() const;
+        size_t dimensions() const;
+
+        // Write the coordinates of the candidate point with the given index, return false if it is rejected by a filter
+        bool get(uint64_t index, std::vector<double>& point) const;
+
+        class node;
+
+    private:
+        explicit scanspace(std::shared_ptr<const node> space) : m_node(std::move(space)) {}
+        std::shared_ptr<const node> m_node;
+    };
+
+    // Evaluated scan point
+    struct scanresult {
+        // Index of the point in the scan space, coordinates and evaluated values
+        uint64_t index;
+        std::vector<double> point;
+        std::vector<double> values;
+    };
+
+    // Consumer of scan results, called from one thread at a time in the order of completion
+    class scansink {
+    public:
+        virtual ~scansink() = default;
+        virtual void consume(scanresult result) = 0;
+    };
+
+    // Keep the results with the smallest, or largest, value in one column
+    class topsink : public scansink {
+    public:
+        topsink(size_t count, size_t column, bool largest = false);
+        void consume(scanresult result) override;
+
+        // Return the kept results, best first
+        std::vector<scanresult> getResults() const;
+
+    private:
+        // Return whether result a ranks before result b, ties are resolved by the index of the point
+        bool better(const scanresult& a, const scanresult& b) const;
+
+        size_t m_count;
+        size_t m_column;
+        bool m_largest;
+        // Heap with the worst kept result on top:
+        std::vector<scanresult> m_heap;
+    };
+
+    // Keep the results with a value in one column below, or above, a threshold
+    class thresholdsink : public scansink {
+    public:
+        thresholdsink(size_t column, double threshold, bool above = false);
+        void consume(scanresult result) override;
+
+        // Return the kept results ordered by the index of the point
+        std::vector<scanresult> getResults() const;
+
+    private:
+        size_t m_column;
+        double m_threshold;
+        bool m_above;
+        std::vector<scanresult> m_results;
+    };
+
+    // Write every result as one row of coordinates followed by the values to a scan file
+    class filesink : public scansink {
+    public:
+        explicit filesink(scanwriter& writer) : m_writer(writer) {}
+        void consume(scanresult result) override;
+
+    private:
+        scanwriter& m_writer;
+    };
+
+    // Evaluation of all points of a scan space in parallel with the results passed to a sink.
+    // Worker threads claim blocks of indices, generate the points themselves and push the results to a bounded queue,
+    // which is drained by the sink in the calling thread. Workers wait while the queue is full, so the memory in use
+    // depends on the queue length and the sink only, not on the size of the scan space.
+    // The evaluator and the filter predicates of the space are called concurrently from the worker threads and have to be
+    // thread-safe, the sink is only called from the calling thread. An exception thrown by the evaluator or the sink stops
+    // the scan and is rethrown by run.
+    class scanpipeline {
+    public:
+        using evaluator = std::function<std::vector<double>(const std::vector<double>&)>;
+
+        // Pipeline with the given function evaluating a point, number of threads (zero for all cores) and queue length
+        explicit scanpipeline(evaluator evaluate, size_t threads = 0, size_t queue = 1024);
+
+        // Evaluate all points of the space which pass its filters, return the number of results consumed by the sink
+        uint64_t run(const scanspace& space, scansink& sink) const;
+
+    private:
+        evaluator m_evaluate;
+        size_t m_threads;
+        size_t m_queue;
+    };
+
+} // namespace gblsim
+
+#endif /* SCANSPACE_H */
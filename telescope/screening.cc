@@ -0,0 +1,170 @@
+#include "screening.h"
+
+#include "log.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <map>
+
+using namespace gblsim;
+using namespace unilog;
+
+std::vector<screened> screener::evaluate(const std::vector<chain>& chains, size_t point, size_t axis) const {
+
+    std::vector<screened> results(chains.size(), {std::numeric_limits<double>::infinity(), 0., false});
+
+    // Group the configurations by the number of points of their chain:
+    std::map<size_t, std::vector<size_t>> groups;
+    for(size_t i = 0; i < chains.size(); i++) {
+        if(point < chains[i].size()) {
+            groups[chains[i].size()].push_back(i);
+        }
+    }
+
+    size_t fallbacks = 0;
+    for(const auto& group : groups) {
+        std::vector<const chain*> members;
+        for(const auto& i : group.second) {
+            members.push_back(&chains[i]);
+        }
+
+        std::vector<double> variance, bound;
+        std::vector<size_t> failed;
+        if(m_reduced) {
+            evaluate<float>(members, point, axis, variance, bound);
+            for(size_t k = 0; k < members.size(); k++) {
+                if(!(bound[k] <= m_tolerance) || !std::isfinite(variance[k])) {
+                    failed.push_back(k);
+                } else {
+                    results[group.second[k]] = {std::sqrt(variance[k]) * 1E3, bound[k], true};
+                }
+            }
+        } else {
+            failed.resize(members.size());
+            for(size_t k = 0; k < members.size(); k++) {
+                failed[k] = k;
+            }
+        }
+        if(failed.empty()) {
+            continue;
+        }
+
+        // Re-evaluate the failed configurations in double precision:
+        std::vector<const chain*> retry;
+        for(const auto& k : failed) {
+            retry.push_back(members[k]);
+        }
+        evaluate<double>(retry, point, axis, variance, bound);
+        for(size_t r = 0; r < retry.size(); r++) {
+            results[group.second[failed[r]]] = {std::sqrt(variance[r]) * 1E3, bound[r], false};
+        }
+        fallbacks += m_reduced ? retry.size() : 0;
+    }
+
+    LOG(DEBUG) << "Screened " << chains.size() << " configurations in " << groups.size() << " groups, " << fallbacks
+               << " re-evaluated in double precision";
+    return results;
+}
+
+template <typename T>
+void screener::evaluate(const std::vector<const chain*>& chains,
+                        size_t point,
+                        size_t axis,
+                        std::vector<double>& variance,
+                        std::vector<double>& bound) const {
+
+    auto lanes = chains.size();
+    auto points = chains.front()->size();
+
+    // Input field by field with the configurations as innermost dimension. Distances are taken in double precision:
+    std::vector<T> distance(points * lanes), scatterer(points * lanes), measurement(points * lanes);
+    for(size_t l = 0; l < lanes; l++) {
+        const auto& points_l = *chains[l];
+        for(size_t p = 0; p < points; p++) {
+            distance[p * lanes + l] =
+                static_cast<T>(p > 0 ? points_l.getPosition(p) - points_l.getPosition(p - 1) : 0.);
+            scatterer[p * lanes + l] = static_cast<T>(points_l.getScatterer(p));
+            measurement[p * lanes + l] = static_cast<T>(points_l.getMeasurement(p, axis));
+        }
+    }
+
+    const T infinity = std::numeric_limits<T>::infinity();
+
+    // Information matrices (a, b; b, c) of all configurations and the accumulated loss of precision:
+    std::vector<T> a(lanes), b(lanes), c(lanes), loss(lanes, T(1));
+
+    // Straight line propagation over the distance of the given point, forward or backward:
+    auto propagate = [&](size_t p, T sign) {
+        const T* dz = distance.data() + p * lanes;
+        for(size_t l = 0; l < lanes; l++) {
+            T d = sign * dz[l];
+            T bn = b[l] + a[l] * d;
+            T cn = c[l] + T(2) * b[l] * d + a[l] * d * d;
+            // Cancellation in the slope information and the correlation, relative to the scale of the matrix:
+            T scale = c[l] + T(2) * std::abs(b[l] * d) + a[l] * d * d;
+            T norm = std::sqrt(a[l] * cn);
+            loss[l] += (cn > T(0) ? scale / cn : T(1)) + (norm > T(0) ? (std::abs(b[l]) + std::abs(a[l] * d)) / norm : T(1));
+            b[l] = bn;
+            c[l] = cn;
+        }
+    };
+
+    // Measurement and kink of the given point:
+    auto update = [&](size_t p, bool measurement_first) {
+        const T* w = scatterer.data() + p * lanes;
+        const T* m = measurement.data() + p * lanes;
+        for(size_t l = 0; l < lanes; l++) {
+            if(measurement_first) {
+                a[l] += m[l];
+            }
+            // Marginalize the kink, slope information and correlation shrink by w / (w + c) without cancellation:
+            T denominator = w[l] + c[l];
+            T inverse = (denominator > T(0)) ? T(1) / denominator : T(0);
+            T keep = (denominator > T(0) && w[l] < infinity) ? w[l] * inverse : T(1);
+            T an = a[l] - b[l] * b[l] * inverse;
+            loss[l] += (an > T(0)) ? a[l] / an : (a[l] > T(0) ? infinity : T(1));
+            a[l] = an;
+            b[l] *= keep;
+            c[l] *= keep;
+            if(!measurement_first) {
+                a[l] += m[l];
+            }
+        }
+    };
+
+    // Forward filter up to and including the requested point:
+    std::fill(a.begin(), a.end(), T(0));
+    std::fill(b.begin(), b.end(), T(0));
+    std::fill(c.begin(), c.end(), T(0));
+    for(size_t p = 0; p <= point; p++) {
+        if(p > 0) {
+            propagate(p, T(-1));
+        }
+        update(p, true);
+    }
+    std::vector<T> fa = a, fb = b, fc = c;
+
+    // Backward filter with all points downstream of the requested point:
+    std::fill(a.begin(), a.end(), T(0));
+    std::fill(b.begin(), b.end(), T(0));
+    std::fill(c.begin(), c.end(), T(0));
+    for(size_t p = points; p-- > point + 1;) {
+        update(p, false);
+        propagate(p, T(1));
+    }
+
+    // Invert the combined information, the position variance is c / det:
+    variance.resize(lanes);
+    bound.resize(lanes);
+    const double epsilon = static_cast<double>(std::numeric_limits<T>::epsilon());
+    for(size_t l = 0; l < lanes; l++) {
+        T sa = fa[l] + a[l];
+        T sb = fb[l] + b[l];
+        T sc = fc[l] + c[l];
+        T det = sa * sc - sb * sb;
+        T total = loss[l] + ((det > T(0)) ? (sa * sc + sb * sb) / det : infinity);
+        variance[l] = (det > T(0)) ? static_cast<double>(sc / det) : std::numeric_limits<double>::infinity();
+        bound[l] = epsilon * static_cast<double>(total);
+    }
+}
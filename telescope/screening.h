@@ -0,0 +1,52 @@
+#ifndef SCREENING_H
+#define SCREENING_H
+
+#include <vector>
+
+#include "smoother.h"
+
+namespace gblsim {
+
+    // Track resolution of one configuration from a screening evaluation
+    struct screened {
+        // Resolution in [um]
+        double resolution;
+        // Estimated bound on the relative error of the single precision evaluation
+        double bound;
+        // Whether the result has been produced in single precision, otherwise it has been re-evaluated in double
+        bool reduced;
+    };
+
+    // Batched evaluation of the track resolution for many configurations, e.g. when screening candidate layouts.
+    // Chains with the same number of points are evaluated together with the configurations as innermost dimension, so the
+    // filter updates run on full SIMD lanes. The evaluation runs in single precision first and tracks the loss of
+    // precision of every configuration from the cancellations in the kink updates and in the final inversion. This is
+    // essential since the kink precisions of thin air scatterers exceed those of the planes by orders of magnitude.
+    // Configurations whose error bound exceeds the tolerance, or whose result is not finite, are re-evaluated in double.
+    class screener {
+    public:
+        explicit screener(double tolerance = 1e-4) : m_tolerance(tolerance), m_reduced(true) {}
+
+        // Select whether to start in single precision, otherwise all configurations are evaluated in double
+        void setReducedPrecision(bool reduced) { m_reduced = reduced; }
+
+        // Return the resolution along the given axis at the given point of every chain, chains without this point are
+        // returned with infinite resolution
+        std::vector<screened> evaluate(const std::vector<chain>& chains, size_t point, size_t axis) const;
+
+    private:
+        // Evaluate the given chains, all of the same size, with the given floating point type
+        template <typename T>
+        void evaluate(const std::vector<const chain*>& chains,
+                      size_t point,
+                      size_t axis,
+                      std::vector<double>& variance,
+                      std::vector<double>& bound) const;
+
+        double m_tolerance;
+        bool m_reduced;
+    };
+
+} // namespace gblsim
+
+#endif /* SCREENING_H */
@@ -0,0 +1,308 @@
+#include "server.h"
+
+#include "log.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace gblsim;
+using namespace unilog;
+
+namespace {
+    // Longest request accepted, connections sending longer lines are dropped:
+    const size_t max_request = 65536;
+    // Responses queued for a connection before reading further requests from it:
+    const size_t max_pending = 1 << 20;
+
+    // Open connection with its partially received request and the responses not yet sent:
+    struct connection {
+        std::string input;
+        std::string output;
+    };
+} // namespace
+
+server::server(const std::string& path, size_t cache)
+    : m_path(path), m_socket(-1), m_inode(0), m_device(0), m_running(false), m_capacity(std::max<size_t>(cache, 1)),
+      m_requests(0), m_hits(0), m_misses(0) {
+
+    sockaddr_un address{};
+    if(path.size() >= sizeof(address.sun_path)) {
+        throw std::invalid_argument("socket path too long: " + path);
+    }
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+
+    m_socket = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if(m_socket < 0) {
+        throw std::runtime_error("cannot create socket: " + std::string(std::strerror(errno)));
+    }
+
+    // Only replace a stale socket of our own, i.e. one nobody is listening on any more:
+    struct stat existing {};
+    if(::lstat(path.c_str(), &existing) == 0) {
+        bool stale = false;
+        if(S_ISSOCK(existing.st_mode) && existing.st_uid == ::geteuid()) {
+            int probe = ::socket(AF_UNIX, SOCK_STREAM, 0);
+            stale = (probe >= 0 && ::connect(probe, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 &&
+                     errno == ECONNREFUSED);
+            if(probe >= 0) {
+                ::close(probe);
+            }
+        }
+        if(!stale) {
+            ::close(m_socket);
+            throw std::runtime_error("cannot listen on " + path + ": path exists and is not a stale socket of ours");
+        }
+        LOG(INFO) << "Removing stale socket " << path;
+        ::unlink(path.c_str());
+    }
+
+    if(::bind(m_socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 || ::listen(m_socket, 16) < 0) {
+        auto error = std::string(std::strerror(errno));
+        ::close(m_socket);
+        throw std::runtime_error("cannot listen on " + path + ": " + error);
+    }
+    // Remember the socket file, so it is only removed if it is still ours:
+    struct stat bound {};
+    if(::lstat(path.c_str(), &bound) == 0) {
+        m_inode = bound.st_ino;
+        m_device = bound.st_dev;
+    }
+    ::fcntl(m_socket, F_SETFL, O_NONBLOCK);
+    LOG(INFO) << "Listening on " << path;
+}
+
+server::~server() {
+    if(m_socket >= 0) {
+        ::close(m_socket);
+        struct stat current {};
+        if(::lstat(m_path.c_str(), &current) == 0 && current.st_ino == m_inode && current.st_dev == m_device) {
+            ::unlink(m_path.c_str());
+        }
+    }
+}
+
+void server::run() {
+    m_running.store(true);
+
+    // Descriptors of the listening socket and all open connections:
+    std::vector<pollfd> descriptors;
+    std::vector<connection> connections;
+    descriptors.push_back({m_socket, POLLIN, 0});
+    connections.emplace_back();
+
+    auto drop = [&](size_t i) {
+        LOG(DEBUG) << "Closing connection " << descriptors[i].fd;
+        ::close(descriptors[i].fd);
+        descriptors[i].fd = -1;
+    };
+
+    while(m_running.load()) {
+        // Read only from connections which keep up with their responses, wait for writability while responses queue:
+        for(size_t i = 1; i < descriptors.size(); i++) {
+            descriptors[i].events = static_cast<short>((connections[i].output.size() < max_pending ? POLLIN : 0) |
+                                                       (connections[i].output.empty() ? 0 : POLLOUT));
+        }
+
+        // Wake up regularly to notice stop requests:
+        if(::poll(descriptors.data(), descriptors.size(), 100) <= 0) {
+            continue;
+        }
+
+        // Accept all new connections:
+        if((descriptors.front().revents & POLLIN) != 0) {
+            int client;
+            while((client = ::accept(m_socket, nullptr, nullptr)) >= 0) {
+                ::fcntl(client, F_SETFL, O_NONBLOCK);
+                descriptors.push_back({client, POLLIN, 0});
+                connections.emplace_back();
+                LOG(DEBUG) << "Accepted connection " << client;
+            }
+        }
+
+        // Read the pending data of all connections and answer all complete requests in one batch:
+        for(size_t i = 1; i < descriptors.size(); i++) {
+            auto& client = connections[i];
+            if((descriptors[i].revents & (POLLIN | POLLHUP | POLLERR)) != 0) {
+                char data[4096];
+                auto bytes = ::read(descriptors[i].fd, data, sizeof(data));
+                if(bytes == 0 || (bytes < 0 && errno != EAGAIN)) {
+                    drop(i);
+                    continue;
+                }
+                if(bytes > 0) {
+                    client.input.append(data, static_cast<size_t>(bytes));
+                }
+
+                size_t end;
+                while((end = client.input.find('\n')) != std::string::npos) {
+                    client.output += handle(client.input.substr(0, end)) + "\n";
+                    client.input.erase(0, end + 1);
+                }
+                if(client.input.size() > max_request) {
+                    LOG(WARNING) << "Request exceeds " << max_request << " bytes, dropping connection";
+                    drop(i);
+                    continue;
+                }
+            }
+
+            // Send as much of the queued responses as the connection takes without blocking:
+            while(!client.output.empty()) {
+                auto result = ::send(descriptors[i].fd, client.output.data(), client.output.size(), MSG_NOSIGNAL);
+                if(result < 0 && errno == EAGAIN) {
+                    break;
+                }
+                if(result <= 0) {
+                    drop(i);
+                    break;
+                }
+                client.output.erase(0, static_cast<size_t>(result));
+            }
+        }
+
+        // Remove closed connections:
+        for(size_t i = descriptors.size(); i-- > 1;) {
+            if(descriptors[i].fd < 0) {
+                descriptors.erase(descriptors.begin() + static_cast<std::ptrdiff_t>(i));
+                connections.erase(connections.begin() + static_cast<std::ptrdiff_t>(i));
+            }
+        }
+    }
+
+    for(size_t i = 1; i < descriptors.size(); i++) {
+        ::close(descriptors[i].fd);
+    }
+    LOG(INFO) << "Served " << m_requests << " requests, " << m_hits << " cache hits, " << m_misses << " misses";
+}
+
+server::entry* server::find(uint64_t hash) {
+    auto it = m_cache.find(hash);
+    if(it == m_cache.end()) {
+        return nullptr;
+    }
+
+    // Mark as most recently used:
+    m_ages.splice(m_ages.begin(), m_ages, it->second.age);
+    return &it->second;
+}
+
+uint64_t server::define(const std::string& arguments) {
+    std::istringstream stream(arguments);
+    double energy;
+    if(!(stream >> energy) || !std::isfinite(energy) || !(energy > 0.)) {
+        throw std::invalid_argument("invalid beam energy");
+    }
+
+    std::vector<plane> planes;
+    std::string token;
+    while(stream >> token) {
+        // Plane as position:material[:resolution[:resolution y]], every field a finite number:
+        std::vector<double> values;
+        std::istringstream fields(token);
+        std::string field;
+        while(std::getline(fields, field, ':')) {
+            size_t parsed = 0;
+            double value = std::stod(field, &parsed);
+            if(parsed != field.size() || !std::isfinite(value)) {
+                throw std::invalid_argument("invalid plane " + token);
+            }
+            values.push_back(value);
+        }
+        if(values.size() < 2 || values.size() > 4) {
+            throw std::invalid_argument("invalid plane " + token);
+        }
+        // Material and resolutions must not be negative, a vanishing resolution along x means no measurement:
+        if(std::any_of(values.begin() + 1, values.end(), [](double value) { return value < 0.; }) ||
+           (values.size() == 4 && values[2] > 0. && !(values[3] > 0.))) {
+            throw std::invalid_argument("invalid plane " + token);
+        }
+
+        if(values.size() == 2 || values[2] <= 0.) {
+            planes.push_back(plane::inactive(values[0], values[1]));
+        } else {
+            planes.push_back(plane::active(values[0], values[1], {values[2], values.size() > 3 ? values[3] : values[2]}));
+        }
+    }
+    if(planes.size() < 2) {
+        throw std::invalid_argument("at least two planes required");
+    }
+
+    // Building the telescope is cheap compared to its smoothers, and its hash identifies equivalent definitions:
+    auto tel = std::make_unique<telescope>(planes, energy);
+    auto hash = tel->getHash();
+    if(find(hash) != nullptr) {
+        m_hits++;
+        return hash;
+    }
+    m_misses++;
+
+    // Build the telescope and keep its smoothers for both dimensions:
+    entry cached;
+    cached.tel = std::move(tel);
+    cached.smoothers.emplace_back(cached.tel->getChain(), 0);
+    cached.smoothers.emplace_back(cached.tel->getChain(), 1);
+
+    if(m_cache.size() >= m_capacity) {
+        LOG(DEBUG) << "Evicting geometry " << m_ages.back();
+        m_cache.erase(m_ages.back());
+        m_ages.pop_back();
+    }
+    m_ages.push_front(hash);
+    cached.age = m_ages.begin();
+    m_cache.emplace(hash, std::move(cached));
+    return hash;
+}
+
+std::string server::handle(const std::string& request) {
+    m_requests++;
+
+    std::istringstream stream(request);
+    std::string command;
+    stream >> command;
+
+    std::ostringstream response;
+    try {
+        if(command == "geometry") {
+            std::string arguments;
+            std::getline(stream, arguments);
+            response << "ok " << std::hex << std::setw(16) << std::setfill('0') << define(arguments);
+        } else if(command == "resolution") {
+            std::string id;
+            size_t pl;
+            if(!(stream >> id >> pl)) {
+                throw std::invalid_argument("expected geometry hash and plane");
+            }
+            auto* cached = find(std::stoull(id, nullptr, 16));
+            if(cached == nullptr) {
+                throw std::invalid_argument("unknown geometry " + id);
+            }
+            if(pl >= cached->tel->getNumberOfPlanes()) {
+                throw std::invalid_argument("no plane " + std::to_string(pl));
+            }
+
+            auto point = cached->tel->getChainPoint(pl);
+            response << "ok " << std::sqrt(cached->smoothers[0].getCovariance(point)(0, 0)) * 1E3 << " "
+                     << std::sqrt(cached->smoothers[1].getCovariance(point)(0, 0)) * 1E3;
+        } else if(command == "stats") {
+            response << "ok " << m_requests << " " << m_hits << " " << m_misses << " " << m_cache.size();
+        } else {
+            throw std::invalid_argument("unknown request \"" + command + "\"");
+        }
+    } catch(std::exception& e) {
+        LOG(WARNING) << "Failed request \"" << request << "\": " << e.what();
+        return "error " + std::string(e.what());
+    }
+    return response.str();
+}
@@ -0,0 +1,76 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "assembly.h"
+#include "smoother.h"
+
+namespace gblsim {
+
+    // Resolution service on a local Unix domain socket, keeping recently used telescopes in memory.
+    // Requests and responses are single lines of text, responses start with "ok" or "error":
+    //   geometry <energy> <z>:<x/X0>[:<resolution>[:<resolution y>]] ...   define a telescope, returns its hash
+    //   resolution <hash> <plane>                                          track resolution in [um] for x and y at the
+    //                                                                      plane with the given index in z order
+    //   stats                                                              requests, cache hits and misses, cached
+    // Positions and resolutions are given in [mm], planes without resolution have no measurement. Non-finite values and
+    // negative materials or resolutions are rejected. Telescopes are cached by telescope::getHash with least-recently-used
+    // eviction, so equivalent definitions share an entry. Queries for an evicted geometry fail and the geometry has to be
+    // sent again. All requests pending on any connection are handled in one batch per wakeup.
+    // Responses are queued per connection and sent without blocking, so a slow client does not stall the others.
+    // Connections sending requests longer than 64 kB are dropped. An existing socket file is only replaced if it is a
+    // stale socket of the same user.
+    class server {
+    public:
+        server(const std::string& path, size_t cache = 64);
+        ~server();
+
+        server(const server&) = delete;
+        server& operator=(const server&) = delete;
+
+        // Serve requests until stop() is called
+        void run();
+        // Request the server loop to terminate, safe to call from signal handlers
+        void stop() { m_running.store(false); }
+
+        // Answer a single request
+        std::string handle(const std::string& request);
+
+    private:
+        struct entry {
+            std::unique_ptr<telescope> tel;
+            std::vector<smoother> smoothers;
+            std::list<uint64_t>::iterator age;
+        };
+
+        // Return the cached telescope with the given hash, or nullptr if unknown
+        entry* find(uint64_t hash);
+        uint64_t define(const std::string& arguments);
+
+        std::string m_path;
+        int m_socket;
+        // Socket file created by this server, only removed if it has not been replaced:
+        uint64_t m_inode;
+        uint64_t m_device;
+        std::atomic<bool> m_running;
+
+        size_t m_capacity;
+        std::unordered_map<uint64_t, entry> m_cache;
+        // Hashes of the cached telescopes, most recently used first:
+        std::list<uint64_t> m_ages;
+
+        uint64_t m_requests;
+        uint64_t m_hits;
+        uint64_t m_misses;
+    };
+
+} // namespace gblsim
+
+#endif /* SERVER_H */
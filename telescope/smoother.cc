@@ -0,0 +1,273 @@
+#include "smoother.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <thread>
+
+#include <Eigen/LU>
+
+using namespace gblsim;
+
+namespace {
+    // Chain length from which the filters run on all cores by default, and shortest segment handled by one thread:
+    const size_t parallel_points = 10000;
+    const size_t segment_points = 256;
+
+    // One step of a filter. The forward filter propagates, adds the measurement and removes the kink, the backward filter
+    // applies the same operations in reverse order
+    struct filterstep {
+        double dz;
+        double measurement;
+        double kink;
+    };
+
+    void apply(Eigen::Matrix2d& info, const filterstep& step, bool backward) {
+        auto jac = smoother::propagator(step.dz);
+        if(backward) {
+            info = smoother::addKink(info, step.kink);
+            info(0, 0) += step.measurement;
+            info = jac.transpose() * info * jac;
+        } else {
+            info = jac.transpose() * info * jac;
+            info(0, 0) += step.measurement;
+            info = smoother::addKink(info, step.kink);
+        }
+    }
+
+    // Summary of a segment of steps as Gaussian relation between the states entering and leaving it: given the entry
+    // state s, the exit state is distributed around A s with covariance C, and the measurements within the segment carry
+    // the information J on s. The kink precisions enter as covariances, so segments with free kinks have no summary.
+    struct segment {
+        Eigen::Matrix2d transfer{Eigen::Matrix2d::Identity()};
+        Eigen::Matrix2d covariance{Eigen::Matrix2d::Zero()};
+        Eigen::Matrix2d information{Eigen::Matrix2d::Zero()};
+        bool valid{true};
+
+        void add(const filterstep& step, bool backward) {
+            if(!(step.kink > 0.)) {
+                valid = false;
+                return;
+            }
+            // Propagation to the next point, in the direction of the filter:
+            auto propagate = [&]() {
+                auto jac = smoother::propagator(-step.dz);
+                transfer = jac * transfer;
+                covariance = jac * covariance * jac.transpose();
+            };
+            auto kink = [&]() {
+                if(!std::isinf(step.kink)) {
+                    covariance(1, 1) += 1. / step.kink;
+                }
+            };
+
+            backward ? kink() : propagate();
+            if(step.measurement > 0.) {
+                // Kalman update with the position measurement, conditional on the entry state:
+                double variance = covariance(0, 0) + 1. / step.measurement;
+                Eigen::Vector2d row = transfer.row(0).transpose();
+                information += row * row.transpose() / variance;
+                Eigen::Vector2d gain = covariance.col(0) / variance;
+                transfer -= gain * transfer.row(0);
+                covariance -= gain * covariance.row(0);
+            }
+            backward ? propagate() : kink();
+        }
+
+        // Information on the exit state given the information on the entry state, marginalizing the entry state:
+        // C^-1 - C^-1 A (I + J + A^T C^-1 A)^-1 A^T C^-1. False if the covariance is too close to singular
+        bool getExit(const Eigen::Matrix2d& entry, Eigen::Matrix2d& exit) const {
+            if(!valid || !(covariance.determinant() > 1e-9 * covariance(0, 0) * covariance(1, 1))) {
+                return false;
+            }
+            Eigen::Matrix2d precision = covariance.inverse();
+            Eigen::Matrix2d coupling = precision * transfer;
+            Eigen::Matrix2d joint = entry + information + transfer.transpose() * coupling;
+            exit = precision - coupling * joint.inverse() * coupling.transpose();
+            exit = (exit + exit.transpose()) / 2.;
+            return true;
+        }
+    };
+
+    // Run a filter over all steps, starting without information, and return the information after every step
+    std::vector<Eigen::Matrix2d> filter(const std::vector<filterstep>& steps, bool backward, size_t threads) {
+        std::vector<Eigen::Matrix2d> states(steps.size());
+        auto run = [&](size_t first, size_t last, Eigen::Matrix2d info) {
+            for(size_t k = first; k < last; k++) {
+                apply(info, steps[k], backward);
+                states[k] = info;
+            }
+        };
+
+        size_t segments = std::min(threads, steps.size() / segment_points);
+        if(segments < 2) {
+            run(0, steps.size(), Eigen::Matrix2d::Zero());
+            return states;
+        }
+        std::vector<size_t> bounds(segments + 1);
+        for(size_t s = 0; s <= segments; s++) {
+            bounds[s] = steps.size() * s / segments;
+        }
+
+        // Summarize all inner segments while the first segment is filtered directly:
+        std::vector<segment> summaries(segments);
+        auto summarize = [&](size_t s) {
+            for(size_t k = bounds[s]; k < bounds[s + 1] && summaries[s].valid; k++) {
+                summaries[s].add(steps[k], backward);
+            }
+        };
+        std::vector<std::thread> workers;
+        for(size_t s = 1; s + 1 < segments; s++) {
+            workers.emplace_back(summarize, s);
+        }
+        run(bounds[0], bounds[1], Eigen::Matrix2d::Zero());
+        for(auto& worker : workers) {
+            worker.join();
+        }
+        workers.clear();
+
+        // Chain the summaries to obtain the information entering every segment, stepping through those without summary:
+        std::vector<Eigen::Matrix2d> entry(segments);
+        entry[1] = states[bounds[1] - 1];
+        for(size_t s = 1; s + 1 < segments; s++) {
+            if(!summaries[s].getExit(entry[s], entry[s + 1])) {
+                entry[s + 1] = entry[s];
+                for(size_t k = bounds[s]; k < bounds[s + 1]; k++) {
+                    apply(entry[s + 1], steps[k], backward);
+                }
+            }
+        }
+
+        // Filter all remaining segments from their entry information:
+        for(size_t s = 2; s < segments; s++) {
+            workers.emplace_back(run, bounds[s], bounds[s + 1], entry[s]);
+        }
+        run(bounds[1], bounds[2], entry[1]);
+        for(auto& worker : workers) {
+            worker.join();
+        }
+        return states;
+    }
+} // namespace
+
+void chain::addPoint(double position, double scatterer, std::pair<double, double> measurement) {
+    m_position.push_back(position);
+    m_scatterer.push_back(scatterer);
+    m_measurement[0].push_back(measurement.first);
+    m_measurement[1].push_back(measurement.second);
+}
+
+smoother::smoother(const chain& points, size_t axis, size_t threads)
+    : m_position(points.size()), m_scatterer(points.size()), m_forward(points.size()), m_backward(points.size()) {
+
+    for(size_t i = 0; i < points.size(); i++) {
+        m_position[i] = points.getPosition(i);
+        m_scatterer[i] = points.getScatterer(i);
+    }
+    if(threads == 0) {
+        threads = (points.size() >= parallel_points) ? std::max(std::thread::hardware_concurrency(), 1u) : 1;
+    }
+
+    // Forward filter, starting without any prior information on the track:
+    std::vector<filterstep> steps(points.size());
+    for(size_t i = 0; i < points.size(); i++) {
+        steps[i] = {i > 0 ? m_position[i - 1] - m_position[i] : 0., points.getMeasurement(i, axis), m_scatterer[i]};
+    }
+    m_forward = filter(steps, false, threads);
+
+    // Backward filter, collecting the information downstream of each point:
+    if(points.size() > 0) {
+        steps.resize(points.size() - 1);
+        for(size_t i = points.size(); i-- > 1;) {
+            steps[points.size() - 1 - i] = {
+                m_position[i] - m_position[i - 1], points.getMeasurement(i, axis), m_scatterer[i]};
+        }
+        auto backward = filter(steps, true, threads);
+        m_backward[points.size() - 1].setZero();
+        for(size_t i = 0; i + 1 < points.size(); i++) {
+            m_backward[i] = backward[points.size() - 2 - i];
+        }
+    }
+}
+
+Eigen::Matrix2d smoother::propagator(double dz) {
+    Eigen::Matrix2d jac;
+    jac << 1., dz, 0., 1.;
+    return jac;
+}
+
+Eigen::Matrix2d smoother::addKink(const Eigen::Matrix2d& information, double precision) {
+    // Marginalize the kink angle, (I^-1 + e1 e1^T / w)^-1 = I - I e1 e1^T I / (w + I_11), also valid for singular I:
+    double denominator = precision + information(1, 1);
+    if(!(denominator > 0.) || std::isinf(denominator)) {
+        return information;
+    }
+    Eigen::Vector2d column = information.col(1);
+    return information - column * column.transpose() / denominator;
+}
+
+Eigen::Matrix2d smoother::getTransfer(size_t point) const {
+    auto jac = propagator(m_position[point] - m_position[point - 1]);
+
+    // Expected kink given the downstream information, the position is fixed by the previous state:
+    double denominator = m_scatterer[point] + m_backward[point](1, 1);
+    if(!(denominator > 0.) || std::isinf(denominator)) {
+        return jac;
+    }
+    Eigen::Matrix2d gain = Eigen::Matrix2d::Identity();
+    gain.row(1) -= m_backward[point].row(1) / denominator;
+    return gain * jac;
+}
+
+Eigen::Matrix2d smoother::getCovariance(size_t point) const {
+    Eigen::Matrix2d info = m_forward[point] + m_backward[point];
+
+    // Track not constrained at this point:
+    if(!(info.determinant() > 0.)) {
+        return Eigen::Matrix2d::Constant(std::numeric_limits<double>::infinity());
+    }
+    return info.inverse();
+}
+
+Eigen::Matrix2d smoother::getCovariance(size_t point_a, size_t point_b) const {
+    if(point_a > point_b) {
+        return getCovariance(point_b, point_a).transpose();
+    }
+
+    // Lag recursion, Cov(s_a, s_b) = C_a A_a+1^T ... A_b^T:
+    Eigen::Matrix2d cov = getCovariance(point_a);
+    for(size_t i = point_a + 1; i <= point_b; i++) {
+        cov = cov * getTransfer(i).transpose();
+    }
+    return cov;
+}
+
+Eigen::MatrixXd smoother::getCovariance(const std::vector<size_t>& points) const {
+
+    // Visit the requested points in z order to run the lag recursion only once along the chain:
+    std::vector<size_t> order(points.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return points[a] < points[b]; });
+
+    // Accumulated transfer between consecutive requested points:
+    std::vector<Eigen::Matrix2d> transfer(points.size(), Eigen::Matrix2d::Identity());
+    for(size_t k = 1; k < order.size(); k++) {
+        for(size_t i = points[order[k - 1]] + 1; i <= points[order[k]]; i++) {
+            transfer[k] = getTransfer(i) * transfer[k];
+        }
+    }
+
+    Eigen::MatrixXd cov(2 * points.size(), 2 * points.size());
+    for(size_t a = 0; a < order.size(); a++) {
+        Eigen::Matrix2d block = getCovariance(points[order[a]]);
+        cov.block<2, 2>(static_cast<Eigen::Index>(2 * order[a]), static_cast<Eigen::Index>(2 * order[a])) = block;
+        for(size_t b = a + 1; b < order.size(); b++) {
+            block = block * transfer[b].transpose();
+            cov.block<2, 2>(static_cast<Eigen::Index>(2 * order[a]), static_cast<Eigen::Index>(2 * order[b])) = block;
+            cov.block<2, 2>(static_cast<Eigen::Index>(2 * order[b]), static_cast<Eigen::Index>(2 * order[a])) =
+                block.transpose();
+        }
+    }
+    return cov;
+}
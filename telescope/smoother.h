@@ -0,0 +1,80 @@
+#ifndef SMOOTHER_H
+#define SMOOTHER_H
+
+#include <array>
+#include <utility>
+#include <vector>
+
+#include <Eigen/Core>
+
+namespace gblsim {
+
+    // Points of a trajectory along the beam axis, stored field by field.
+    // Every point carries a thin scatterer with a kink precision and an optional measurement with a precision per axis.
+    // A kink precision of infinity denotes a point without scatterer, a kink precision of zero a free kink with unknown
+    // material. A measurement precision of zero denotes a point without measurement. Points have to be added in z.
+    class chain {
+    public:
+        // Append a point at the given position [mm] with kink precision [1/rad^2] and measurement precisions [1/mm^2]
+        void addPoint(double position, double scatterer, std::pair<double, double> measurement);
+
+        size_t size() const { return m_position.size(); }
+
+        double getPosition(size_t point) const { return m_position[point]; }
+        double getScatterer(size_t point) const { return m_scatterer[point]; }
+        double getMeasurement(size_t point, size_t axis) const { return m_measurement[axis][point]; }
+
+        void setScatterer(size_t point, double precision) { m_scatterer[point] = precision; }
+        void setMeasurement(size_t point, size_t axis, double precision) { m_measurement[axis][point] = precision; }
+
+    private:
+        std::vector<double> m_position;
+        std::vector<double> m_scatterer;
+        std::array<std::vector<double>, 2> m_measurement;
+    };
+
+    // Two-filter smoother for the track state (position, slope) along one axis of a chain.
+    // As all residuals vanish for the simulated track, only information matrices are propagated. The state of a point is
+    // defined on the side towards the next point, i.e. after the kink of its scatterer. The forward information of a point
+    // contains all measurements and kinks up to and including the point, the backward information all measurements and
+    // kinks downstream of it. Cross-covariances between points are obtained with the smoother lag recursion.
+    // For long chains both filters are split into segments handled by separate threads. Every filter step is a linear
+    // fractional map of the information matrix, so each thread first composes the map of its segment, the segment maps
+    // are then chained to obtain the information entering every segment, and each thread finally runs the filter over its
+    // segment from there. Segments containing free kinks, which have no such map, are stepped through point by point.
+    class smoother {
+    public:
+        // Smoother of one axis of the chain, with the number of threads used for the filters. Zero selects all cores for
+        // chains of at least 10^4 points and a single thread otherwise
+        smoother(const chain& points, size_t axis, size_t threads = 0);
+
+        size_t size() const { return m_forward.size(); }
+
+        // Return the covariance of position and slope at the given point
+        Eigen::Matrix2d getCovariance(size_t point) const;
+        // Return the cross-covariance between the states at two points
+        Eigen::Matrix2d getCovariance(size_t point_a, size_t point_b) const;
+        // Return the joint covariance of the states at the given points, ordered as (position, slope) per point
+        Eigen::MatrixXd getCovariance(const std::vector<size_t>& points) const;
+
+        const Eigen::Matrix2d& getForward(size_t point) const { return m_forward[point]; }
+        const Eigen::Matrix2d& getBackward(size_t point) const { return m_backward[point]; }
+
+        // Straight line propagation of the track state over the distance dz
+        static Eigen::Matrix2d propagator(double dz);
+        // Remove the information on the slope carried across a kink with the given precision
+        static Eigen::Matrix2d addKink(const Eigen::Matrix2d& information, double precision);
+
+    private:
+        // Transfer of the smoothed state from the previous point to the given one, E[s_i | s_i-1] = A_i s_i-1
+        Eigen::Matrix2d getTransfer(size_t point) const;
+
+        std::vector<double> m_position;
+        std::vector<double> m_scatterer;
+        std::vector<Eigen::Matrix2d> m_forward;
+        std::vector<Eigen::Matrix2d> m_backward;
+    };
+
+} // namespace gblsim
+
+#endif /* SMOOTHER_H */
@@ -0,0 +1,442 @@
+#include "surrogate.h"
+
+#include "log.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <thread>
+
+using namespace gblsim;
+using namespace unilog;
+
+namespace {
+    const char surrogate_magic[8] = {'T', 'R', 'S', 'U', 'R', 'R', '0', '1'};
+    // Limits of the number of parameters and the degree along each of them accepted from files:
+    const uint64_t max_axes = 64;
+    const uint64_t max_file_degree = 1024;
+
+    // Whether the parameter range can be mapped to the Chebyshev interval
+    bool isValid(const surrogateaxis& axis) {
+        return std::isfinite(axis.lower) && std::isfinite(axis.upper) && axis.lower < axis.upper &&
+               (!axis.logarithmic || axis.lower > 0.);
+    }
+
+    // Number of entries of a tensor with the given degrees
+    size_t getEntries(const std::vector<size_t>& degrees) {
+        return std::accumulate(
+            degrees.begin(), degrees.end(), size_t(1), [](size_t product, size_t degree) { return product * (degree + 1); });
+    }
+
+    // Distance between neighbouring entries along one dimension, the last dimension varies fastest
+    size_t getStride(const std::vector<size_t>& degrees, size_t axis) {
+        size_t stride = 1;
+        for(size_t d = axis + 1; d < degrees.size(); d++) {
+            stride *= degrees[d] + 1;
+        }
+        return stride;
+    }
+
+    // Index along one dimension of the given entry
+    size_t getIndex(const std::vector<size_t>& degrees, size_t entry, size_t axis) {
+        return (entry / getStride(degrees, axis)) % (degrees[axis] + 1);
+    }
+
+    // Transform values on the Chebyshev-Lobatto grid to Chebyshev coefficients, with a DCT-I along every dimension
+    std::vector<double> getCoefficients(std::vector<double> values, const std::vector<size_t>& degrees) {
+        std::vector<double> line;
+        for(size_t axis = 0; axis < degrees.size(); axis++) {
+            auto n = degrees[axis];
+            auto stride = getStride(degrees, axis);
+            std::vector<double> cosine((n + 1) * (n + 1));
+            for(size_t j = 0; j <= n; j++) {
+                for(size_t k = 0; k <= n; k++) {
+                    cosine[j * (n + 1) + k] = std::cos(M_PI * static_cast<double>(j * k) / static_cast<double>(n));
+                }
+            }
+
+            line.resize(n + 1);
+            for(size_t entry = 0; entry < values.size(); entry++) {
+                if(getIndex(degrees, entry, axis) != 0) {
+                    continue;
+                }
+                for(size_t k = 0; k <= n; k++) {
+                    double sum = 0;
+                    for(size_t j = 0; j <= n; j++) {
+                        double weight = (j == 0 || j == n) ? 0.5 : 1.;
+                        sum += weight * values[entry + j * stride] * cosine[j * (n + 1) + k];
+                    }
+                    line[k] = sum * 2. / static_cast<double>(n) * ((k == 0 || k == n) ? 0.5 : 1.);
+                }
+                for(size_t k = 0; k <= n; k++) {
+                    values[entry + k * stride] = line[k];
+                }
+            }
+        }
+        return values;
+    }
+} // namespace
+
+surrogate::surrogate(
+    const function& evaluate, std::vector<surrogateaxis> axes, uint64_t hash, double tolerance, size_t max_degree)
+    : m_axes(std::move(axes)), m_hash(hash) {
+
+    for(const auto& axis : m_axes) {
+        if(!isValid(axis)) {
+            throw std::invalid_argument("surrogate parameter ranges need finite bounds with lower < upper, and lower > 0 "
+                                        "for logarithmic parameters");
+        }
+    }
+
+    auto dimensions = m_axes.size();
+    auto threads = static_cast<size_t>(std::max(std::thread::hardware_concurrency(), 1u));
+    auto level = Log::getReportingLevel();
+    auto format = Log::getFormat();
+
+    // Evaluate the function at the given points in parallel, the first exception stops all threads and is rethrown:
+    auto sample = [&](const std::vector<std::vector<double>>& points) {
+        std::vector<double> values(points.size());
+        std::atomic<size_t> next(0);
+        std::atomic<bool> abort(false);
+        std::mutex mutex;
+        std::exception_ptr error;
+        auto work = [&]() {
+            Log::setReportingLevel(level);
+            Log::setFormat(format);
+            try {
+                for(size_t i = next++; i < points.size() && !abort; i = next++) {
+                    values[i] = evaluate(points[i]);
+                }
+            } catch(...) {
+                std::lock_guard<std::mutex> lock(mutex);
+                if(!error) {
+                    error = std::current_exception();
+                }
+                abort = true;
+            }
+        };
+        std::vector<std::thread> workers;
+        for(size_t t = 1; t < std::min(threads, points.size()); t++) {
+            workers.emplace_back(work);
+        }
+        work();
+        for(auto& worker : workers) {
+            worker.join();
+        }
+        if(error) {
+            std::rethrow_exception(error);
+        }
+        m_evaluations += points.size();
+        return values;
+    };
+
+    // Parameters of the given grid entry, node j of degree n is at cos(pi j / n):
+    auto getPoint = [&](const std::vector<size_t>& degrees, size_t entry) {
+        std::vector<double> point(dimensions);
+        for(size_t d = 0; d < dimensions; d++) {
+            auto j = static_cast<double>(getIndex(degrees, entry, d));
+            point[d] = getParameter(d, std::cos(M_PI * j / static_cast<double>(degrees[d])));
+        }
+        return point;
+    };
+
+    std::vector<size_t> degrees(dimensions, std::min<size_t>(4, std::max<size_t>(max_degree, 1)));
+    std::vector<double> values;
+    {
+        std::vector<std::vector<double>> points;
+        for(size_t entry = 0; entry < getEntries(degrees); entry++) {
+            points.push_back(getPoint(degrees, entry));
+        }
+        values = sample(points);
+    }
+
+    // Magnitude of the two highest coefficients along every dimension, estimating the interpolation error:
+    auto getTails = [&](const std::vector<double>& coefficients) {
+        std::vector<double> tails(dimensions, 0.);
+        for(size_t d = 0; d < dimensions; d++) {
+            std::vector<double> highest(2, 0.);
+            for(size_t entry = 0; entry < coefficients.size(); entry++) {
+                auto k = getIndex(degrees, entry, d);
+                if(k + 2 > degrees[d]) {
+                    auto& slab = highest[degrees[d] - k];
+                    slab = std::max(slab, std::abs(coefficients[entry]));
+                }
+            }
+            tails[d] = highest[0] + highest[1];
+        }
+        return tails;
+    };
+
+    std::vector<double> coefficients;
+    std::vector<double> tails;
+    while(true) {
+        coefficients = getCoefficients(values, degrees);
+        tails = getTails(coefficients);
+
+        bool refined = false;
+        for(size_t d = 0; d < dimensions; d++) {
+            if(tails[d] <= tolerance / static_cast<double>(4 * dimensions)) {
+                continue;
+            }
+            if(2 * degrees[d] > max_degree) {
+                continue;
+            }
+
+            // Double the degree along this dimension, previous nodes are every second node of the refined grid:
+            auto refined_degrees = degrees;
+            refined_degrees[d] *= 2;
+            std::vector<double> refined_values(getEntries(refined_degrees));
+            std::vector<std::vector<double>> points;
+            std::vector<size_t> missing;
+            for(size_t entry = 0; entry < refined_values.size(); entry++) {
+                if(getIndex(refined_degrees, entry, d) % 2 == 0) {
+                    continue;
+                }
+                points.push_back(getPoint(refined_degrees, entry));
+                missing.push_back(entry);
+            }
+            auto sampled = sample(points);
+            for(size_t i = 0; i < missing.size(); i++) {
+                refined_values[missing[i]] = sampled[i];
+            }
+            for(size_t entry = 0; entry < values.size(); entry++) {
+                size_t refined_entry = 0;
+                for(size_t a = 0; a < dimensions; a++) {
+                    auto index = getIndex(degrees, entry, a) * (a == d ? 2 : 1);
+                    refined_entry += index * getStride(refined_degrees, a);
+                }
+                refined_values[refined_entry] = values[entry];
+            }
+
+            LOG(DEBUG) << "Refined surrogate parameter " << d << " to degree " << refined_degrees[d];
+            degrees = refined_degrees;
+            values = std::move(refined_values);
+            refined = true;
+            break;
+        }
+        if(!refined) {
+            break;
+        }
+    }
+
+    double interpolation = std::accumulate(tails.begin(), tails.end(), 0.);
+    if(interpolation > tolerance) {
+        LOG(WARNING) << "Surrogate did not converge to tolerance " << tolerance << " within maximum degree " << max_degree
+                     << ", estimated error " << interpolation;
+    }
+
+    // Drop the highest coefficients along any dimension as long as their sum stays within a quarter of the tolerance:
+    double dropped = 0;
+    std::vector<size_t> kept = degrees;
+    for(bool chopped = true; chopped;) {
+        chopped = false;
+        for(size_t d = 0; d < dimensions; d++) {
+            if(kept[d] == 0) {
+                continue;
+            }
+            double slab = 0;
+            for(size_t entry = 0; entry < coefficients.size(); entry++) {
+                bool inside = true;
+                for(size_t a = 0; a < dimensions; a++) {
+                    inside &= (getIndex(degrees, entry, a) <= kept[a]);
+                }
+                if(inside && getIndex(degrees, entry, d) == kept[d]) {
+                    slab += std::abs(coefficients[entry]);
+                }
+            }
+            if(dropped + slab <= tolerance / 4.) {
+                dropped += slab;
+                kept[d]--;
+                chopped = true;
+            }
+        }
+    }
+
+    m_degrees = kept;
+    m_coefficients.resize(getEntries(m_degrees));
+    for(size_t entry = 0; entry < m_coefficients.size(); entry++) {
+        size_t source = 0;
+        for(size_t a = 0; a < dimensions; a++) {
+            source += getIndex(m_degrees, entry, a) * getStride(degrees, a);
+        }
+        m_coefficients[entry] = coefficients[source];
+    }
+    m_bound = interpolation + dropped;
+
+    // Validate the bound at random points off the grid:
+    std::mt19937_64 generator(hash);
+    std::uniform_real_distribution<double> uniform(-1., 1.);
+    std::vector<std::vector<double>> points(16 * dimensions, std::vector<double>(dimensions));
+    for(auto& point : points) {
+        for(size_t d = 0; d < dimensions; d++) {
+            point[d] = getParameter(d, uniform(generator));
+        }
+    }
+    auto validation = sample(points);
+    double deviation = 0;
+    for(size_t i = 0; i < points.size(); i++) {
+        deviation = std::max(deviation, std::abs(validation[i] - (*this)(points[i])));
+    }
+    m_bound = std::max(m_bound, deviation);
+
+    LOG(INFO) << "Built surrogate with " << m_coefficients.size() << " coefficients from " << m_evaluations
+              << " evaluations, error bound " << m_bound << " (largest validation deviation " << deviation << ")";
+}
+
+double surrogate::getReduced(size_t axis, double parameter) const {
+    const auto& range = m_axes[axis];
+    double reduced = range.logarithmic
+                         ? 2. * std::log(parameter / range.lower) / std::log(range.upper / range.lower) - 1.
+                         : 2. * (parameter - range.lower) / (range.upper - range.lower) - 1.;
+    return std::min(std::max(reduced, -1.), 1.);
+}
+
+double surrogate::getParameter(size_t axis, double reduced) const {
+    const auto& range = m_axes[axis];
+    double fraction = (reduced + 1.) / 2.;
+    return range.logarithmic ? range.lower * std::pow(range.upper / range.lower, fraction)
+                             : range.lower + fraction * (range.upper - range.lower);
+}
+
+double surrogate::evaluate(const double* parameters) const {
+    // Scratch space per thread, holding the Chebyshev polynomials of all parameters followed by the partial contraction:
+    thread_local std::vector<double> scratch;
+    auto polynomials = std::accumulate(m_degrees.begin(), m_degrees.end(), m_degrees.size());
+    auto size = m_coefficients.size();
+    scratch.resize(polynomials + size / (m_degrees.empty() ? 1 : m_degrees.front() + 1));
+    double* polynomial = scratch.data();
+    double* buffer = polynomial + polynomials;
+
+    // Contract the coefficients dimension by dimension, starting with the first so the inner loop runs over contiguous
+    // independent sums. Polynomials are taken from the recurrence T_k+1 = 2 x T_k - T_k-1:
+    const double* input = m_coefficients.data();
+    for(size_t d = 0; d < m_degrees.size(); d++) {
+        double x = getReduced(d, parameters[d]);
+        auto n = m_degrees[d] + 1;
+        polynomial[0] = 1.;
+        if(n > 1) {
+            polynomial[1] = x;
+        }
+        for(size_t k = 2; k < n; k++) {
+            polynomial[k] = 2. * x * polynomial[k - 1] - polynomial[k - 2];
+        }
+
+        auto inner = size / n;
+        for(size_t i = 0; i < inner; i++) {
+            buffer[i] = polynomial[0] * input[i];
+        }
+        for(size_t k = 1; k < n; k++) {
+            for(size_t i = 0; i < inner; i++) {
+                buffer[i] += polynomial[k] * input[k * inner + i];
+            }
+        }
+        input = buffer;
+        size = inner;
+        polynomial += n;
+    }
+    return input[0];
+}
+
+void surrogate::save(const std::string& path) const {
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+    if(file == nullptr) {
+        throw std::runtime_error("cannot open surrogate file " + path);
+    }
+
+    auto write = [&](const void* data, size_t size) { std::fwrite(data, 1, size, file); };
+    auto write_uint = [&](uint64_t value) { write(&value, sizeof(value)); };
+    write(surrogate_magic, sizeof(surrogate_magic));
+    write_uint(m_hash);
+    write_uint(m_axes.size());
+    write(&m_bound, sizeof(m_bound));
+    write_uint(m_evaluations);
+    for(size_t d = 0; d < m_axes.size(); d++) {
+        write(&m_axes[d].lower, sizeof(double));
+        write(&m_axes[d].upper, sizeof(double));
+        write_uint(m_axes[d].logarithmic ? 1 : 0);
+        write_uint(m_degrees[d]);
+    }
+    write(m_coefficients.data(), m_coefficients.size() * sizeof(double));
+
+    bool failed = (std::ferror(file) != 0);
+    failed |= (std::fclose(file) != 0);
+    if(failed) {
+        throw std::runtime_error("cannot write surrogate file " + path);
+    }
+}
+
+surrogate surrogate::load(const std::string& path) {
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    if(file == nullptr) {
+        throw std::runtime_error("cannot open surrogate file " + path);
+    }
+
+    bool valid = true;
+    auto read = [&](void* data, size_t size) { valid &= (std::fread(data, 1, size, file) == size); };
+    auto read_uint = [&]() {
+        uint64_t value = 0;
+        read(&value, sizeof(value));
+        return value;
+    };
+
+    // Size of the file, to check the number of coefficients before allocating them:
+    uint64_t file_size = 0;
+    if(std::fseek(file, 0, SEEK_END) == 0) {
+        auto end = std::ftell(file);
+        file_size = (end > 0 ? static_cast<uint64_t>(end) : 0);
+    }
+    valid &= (std::fseek(file, 0, SEEK_SET) == 0);
+
+    surrogate loaded;
+    char magic[sizeof(surrogate_magic)];
+    read(magic, sizeof(magic));
+    valid &= (std::memcmp(magic, surrogate_magic, sizeof(magic)) == 0);
+    loaded.m_hash = read_uint();
+    auto dimensions = read_uint();
+    read(&loaded.m_bound, sizeof(double));
+    loaded.m_evaluations = read_uint();
+    valid &= (dimensions <= max_axes);
+    for(uint64_t d = 0; valid && d < dimensions; d++) {
+        surrogateaxis axis{};
+        read(&axis.lower, sizeof(double));
+        read(&axis.upper, sizeof(double));
+        axis.logarithmic = (read_uint() != 0);
+        auto degree = read_uint();
+        valid &= (degree <= max_file_degree) && isValid(axis);
+        loaded.m_axes.push_back(axis);
+        loaded.m_degrees.push_back(degree);
+    }
+    valid &= (loaded.m_axes.size() == dimensions);
+
+    // The coefficients have to fit into the rest of the file. Their number is accumulated against this limit, so the
+    // product of up to 64 degrees cannot overflow:
+    if(valid) {
+        auto position = std::ftell(file);
+        uint64_t remaining = (position > 0 && file_size > static_cast<uint64_t>(position))
+                                 ? (file_size - static_cast<uint64_t>(position)) / sizeof(double)
+                                 : 0;
+        uint64_t entries = 1;
+        for(const auto& degree : loaded.m_degrees) {
+            valid &= (entries <= remaining / (degree + 1));
+            entries = valid ? entries * (degree + 1) : 0;
+        }
+    }
+    if(valid) {
+        loaded.m_coefficients.resize(getEntries(loaded.m_degrees));
+        read(loaded.m_coefficients.data(), loaded.m_coefficients.size() * sizeof(double));
+    }
+    std::fclose(file);
+
+    if(!valid) {
+        throw std::runtime_error("invalid surrogate file " + path);
+    }
+    LOG(DEBUG) << "Loaded surrogate with " << loaded.m_coefficients.size() << " coefficients from " << path;
+    return loaded;
+}
@@ -0,0 +1,81 @@
+#ifndef SURROGATE_H
+#define SURROGATE_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace gblsim {
+
+    // Parameter range covered by a surrogate
+    struct surrogateaxis {
+        double lower;
+        double upper;
+        // Whether the parameter is approximated in its logarithm, e.g. for material budgets spanning decades
+        bool logarithmic;
+    };
+
+    // Tensor-product Chebyshev approximation of a function of a few continuous parameters, e.g. the DUT resolution as
+    // function of the DUT x/X0, the arm spacing and the beam energy.
+    // The function is sampled on nested Chebyshev-Lobatto grids and the degree along each parameter is doubled until the
+    // highest coefficients along it fall below the tolerance, reusing all previous evaluations. Trailing coefficients are
+    // then dropped as long as their summed magnitude stays within a quarter of the tolerance. The error bound adds the
+    // dropped coefficients, which bound the truncation exactly, to the estimate of the interpolation error from the
+    // highest coefficients, and is raised to the largest deviation seen at random validation points. Evaluation is a
+    // contraction of the coefficients with the Chebyshev polynomials of every parameter, without any fit.
+    // Surrogates carry the hash of the telescope template they approximate, so stale files can be detected on loading.
+    class surrogate {
+    public:
+        using function = std::function<double(const std::vector<double>&)>;
+
+        // Build the surrogate of the given function over the given parameter ranges with absolute tolerance. The hash
+        // identifies the telescope template, e.g. telescope::getHash(). The function is evaluated concurrently on several
+        // threads, an exception thrown by it is rethrown here. Throws std::invalid_argument for empty or non-finite
+        // ranges and for logarithmic ranges not above zero
+        surrogate(const function& evaluate,
+                  std::vector<surrogateaxis> axes,
+                  uint64_t hash,
+                  double tolerance,
+                  size_t max_degree = 64);
+
+        // Read a surrogate from file, throws if the file is not a valid surrogate
+        static surrogate load(const std::string& path);
+        // Write the surrogate to file
+        void save(const std::string& path) const;
+
+        // Return the approximated function value, parameters outside the ranges are clamped to the range
+        double operator()(const std::vector<double>& parameters) const { return evaluate(parameters.data()); }
+        double evaluate(const double* parameters) const;
+
+        // Return the bound on the absolute approximation error
+        double getErrorBound() const { return m_bound; }
+        // Return the hash of the approximated telescope template and check it against a given one
+        uint64_t getHash() const { return m_hash; }
+        bool matches(uint64_t hash) const { return hash == m_hash; }
+
+        // Return the degree along every parameter and the number of function evaluations used to build the surrogate
+        const std::vector<size_t>& getDegrees() const { return m_degrees; }
+        size_t getEvaluations() const { return m_evaluations; }
+
+    private:
+        surrogate() = default;
+
+        // Map a parameter to the Chebyshev interval [-1, 1]
+        double getReduced(size_t axis, double parameter) const;
+        // Map a point of the Chebyshev interval back to the parameter
+        double getParameter(size_t axis, double reduced) const;
+
+        std::vector<surrogateaxis> m_axes;
+        uint64_t m_hash{0};
+        double m_bound{0};
+        size_t m_evaluations{0};
+
+        // Degree along every parameter and coefficients with the last parameter varying fastest:
+        std::vector<size_t> m_degrees;
+        std::vector<double> m_coefficients;
+    };
+
+} // namespace gblsim
+
+#endif /* SURROGATE_H */
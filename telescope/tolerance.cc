@@ -0,0 +1,176 @@
+#include "tolerance.h"
+
+#include "hash.h"
+#include "log.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+using namespace gblsim;
+using namespace unilog;
+
+uncertainty::uncertainty(size_t samples, uint64_t seed)
+    : m_samples(samples), m_seed(seed), m_beam(0.), m_default({0., 0., 0.}) {}
+
+void uncertainty::setTolerance(const tolerance& tol) {
+    m_default = tol;
+}
+
+void uncertainty::setTolerance(size_t plane, const tolerance& tol) {
+    if(m_tolerances.size() <= plane) {
+        m_tolerances.resize(plane + 1, {false, tolerance()});
+    }
+    m_tolerances.at(plane) = {true, tol};
+}
+
+const tolerance& uncertainty::getTolerance(size_t plane) const {
+    if(plane < m_tolerances.size() && m_tolerances.at(plane).first) {
+        return m_tolerances.at(plane).second;
+    }
+    return m_default;
+}
+
+std::vector<double> uncertainty::getNormals(size_t input) const {
+    // Independent stream per input, so the numbers of a plane do not depend on the number of planes:
+    std::mt19937_64 engine(hasher().add(m_seed).add(input).value());
+    std::normal_distribution<double> normal;
+    std::vector<double> normals(m_samples);
+    for(auto& value : normals) {
+        value = normal(engine);
+    }
+    return normals;
+}
+
+std::vector<std::pair<double, double>> uncertainty::getResolutions(const telescope& tel, size_t plane) const {
+
+    const auto& nominal = tel.getChain();
+    auto points = nominal.size();
+    auto planes = tel.getNumberOfPlanes();
+    auto target = tel.getChainPoint(plane);
+
+    // Plane represented by every point of the chain, and the points representing planes in z order:
+    std::vector<size_t> owner(points, planes);
+    for(size_t pl = 0; pl < planes; pl++) {
+        owner.at(tel.getChainPoint(pl)) = pl;
+    }
+    std::vector<size_t> anchors;
+    for(size_t k = 0; k < points; k++) {
+        if(owner[k] < planes) {
+            anchors.push_back(k);
+        }
+    }
+
+    // Enclosing planes of every point, the outermost points move with the nearest plane:
+    std::vector<std::pair<size_t, size_t>> enclosing(points);
+    size_t next = 0;
+    for(size_t k = 0; k < points; k++) {
+        while(next < anchors.size() && anchors[next] < k) {
+            next++;
+        }
+        auto upper = std::min(next, anchors.size() - 1);
+        auto lower = (next < anchors.size() && anchors[next] == k) ? next : (next > 0 ? next - 1 : 0);
+        enclosing[k] = {owner[anchors[lower]], owner[anchors[upper]]};
+    }
+
+    const auto beam = getNormals(0);
+    std::vector<std::vector<double>> normals;
+    for(size_t input = 1; input <= 3 * planes; input++) {
+        normals.push_back(getNormals(input));
+    }
+
+    LOG(DEBUG) << "Sampling " << m_samples << " perturbed telescopes with " << points << " points";
+
+    std::vector<std::pair<double, double>> resolutions;
+    resolutions.reserve(m_samples);
+    std::vector<double> shift(planes);
+    std::vector<double> material(points);
+
+    for(size_t sample = 0; sample < m_samples; sample++) {
+        // Relative spread of the beam momentum, applied to the momentum at every point:
+        double energy = std::max(1. + m_beam * beam[sample], 1e-3);
+
+        for(size_t pl = 0; pl < planes; pl++) {
+            shift[pl] = getTolerance(pl).position * normals[3 * pl][sample];
+        }
+
+        // Perturbed positions and material budgets:
+        chain perturbed;
+        double total = 0;
+        std::vector<double> position(points);
+        for(size_t k = 0; k < points; k++) {
+            double z = nominal.getPosition(k);
+            if(owner[k] < planes) {
+                position[k] = z + shift[owner[k]];
+                double scale = 1. + getTolerance(owner[k]).material * normals[3 * owner[k] + 1][sample];
+                material[k] = tel.getChainMaterial(k) * std::max(scale, 0.);
+            } else {
+                auto lower = enclosing[k].first;
+                auto upper = enclosing[k].second;
+                double z_lower = nominal.getPosition(tel.getChainPoint(lower));
+                double z_upper = nominal.getPosition(tel.getChainPoint(upper));
+                double gap = z_upper - z_lower;
+                double t = (gap > 0.) ? (z - z_lower) / gap : 0.5;
+                position[k] = z + (1. - t) * shift[lower] + t * shift[upper];
+                // Volume material scales with the distance between the planes:
+                double scale = (gap > 0.) ? (gap + shift[upper] - shift[lower]) / gap : 1.;
+                material[k] = tel.getChainMaterial(k) * std::max(scale, 0.);
+            }
+            total += material[k];
+        }
+
+        for(size_t k = 0; k < points; k++) {
+            double scatterer = nominal.getScatterer(k);
+            if(material[k] > 0. && scatterer > 0. && std::isfinite(scatterer)) {
+                double theta = getTheta(energy * tel.getChainMomentum(k), material[k], total);
+                scatterer = 1. / theta / theta;
+            }
+
+            auto measurement = std::make_pair(nominal.getMeasurement(k, 0), nominal.getMeasurement(k, 1));
+            if(owner[k] < planes) {
+                double scale = std::max(1. + getTolerance(owner[k]).resolution * normals[3 * owner[k] + 2][sample], 1e-3);
+                measurement.first /= scale * scale;
+                measurement.second /= scale * scale;
+            }
+            perturbed.addPoint(position[k], scatterer, measurement);
+        }
+
+        smoother x(perturbed, 0);
+        smoother y(perturbed, 1);
+        resolutions.emplace_back(std::sqrt(x.getCovariance(target)(0, 0)) * 1E3,
+                                 std::sqrt(y.getCovariance(target)(0, 0)) * 1E3);
+    }
+    return resolutions;
+}
+
+std::vector<std::pair<double, double>>
+uncertainty::getQuantiles(const telescope& tel, size_t plane, const std::vector<double>& probabilities) const {
+
+    auto resolutions = getResolutions(tel, plane);
+    if(resolutions.empty()) {
+        return std::vector<std::pair<double, double>>(probabilities.size(), {0., 0.});
+    }
+
+    std::vector<double> x, y;
+    for(const auto& res : resolutions) {
+        x.push_back(res.first);
+        y.push_back(res.second);
+    }
+    std::sort(x.begin(), x.end());
+    std::sort(y.begin(), y.end());
+
+    // Linear interpolation between the order statistics:
+    auto quantile = [](const std::vector<double>& values, double probability) {
+        double position = std::min(std::max(probability, 0.), 1.) * static_cast<double>(values.size() - 1);
+        auto lower = static_cast<size_t>(position);
+        auto upper = std::min(lower + 1, values.size() - 1);
+        double t = position - static_cast<double>(lower);
+        return (t > 0.) ? (1. - t) * values[lower] + t * values[upper] : values[lower];
+    };
+
+    std::vector<std::pair<double, double>> quantiles;
+    for(const auto& probability : probabilities) {
+        quantiles.emplace_back(quantile(x, probability), quantile(y, probability));
+    }
+    return quantiles;
+}
@@ -0,0 +1,62 @@
+#ifndef TOLERANCE_H
+#define TOLERANCE_H
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "assembly.h"
+
+namespace gblsim {
+
+    // Gaussian uncertainties of the inputs of one plane
+    struct tolerance {
+        // Absolute uncertainty of the position along the beam in [mm]
+        double position;
+        // Relative uncertainties of the material budget and of the intrinsic resolution
+        double material;
+        double resolution;
+    };
+
+    // Propagation of input tolerances to the track resolution by sampling perturbed telescopes.
+    // The perturbations are applied directly to the chain of the nominal telescope, so the topology is built only once per
+    // geometry and every sample costs one smoother pass per dimension. Positions of points between planes, e.g. volume
+    // scatterers, follow the planes by linear interpolation and the volume material scales with the gap length.
+    // The random numbers depend only on the seed, the sample and the index of the plane, so the same perturbations are
+    // used for every scan point (common random numbers) and the resulting bands are smooth in the scan parameter. They are
+    // regenerated for every evaluation, which costs little against the smoother passes, so the const methods can be used
+    // from several threads at once, e.g. from the evaluator of a scanpipeline.
+    class uncertainty {
+    public:
+        explicit uncertainty(size_t samples, uint64_t seed = 1);
+
+        // Set the tolerances of all planes, or of the plane with the given index in z order
+        void setTolerance(const tolerance& tol);
+        void setTolerance(size_t plane, const tolerance& tol);
+        // Set the relative uncertainty of the beam energy
+        void setBeamTolerance(double relative) { m_beam = relative; }
+
+        size_t getSamples() const { return m_samples; }
+
+        // Return the resolution in [um] in both dimensions at the given plane for every sample
+        std::vector<std::pair<double, double>> getResolutions(const telescope& tel, size_t plane) const;
+        // Return the resolution in [um] in both dimensions at the given plane for each of the given probabilities
+        std::vector<std::pair<double, double>>
+        getQuantiles(const telescope& tel, size_t plane, const std::vector<double>& probabilities) const;
+
+    private:
+        const tolerance& getTolerance(size_t plane) const;
+        // Return the standard normal random numbers of all samples for the given input, i.e. beam energy followed by
+        // position, material and resolution of every plane
+        std::vector<double> getNormals(size_t input) const;
+
+        size_t m_samples;
+        uint64_t m_seed;
+        double m_beam;
+        tolerance m_default;
+        std::vector<std::pair<bool, tolerance>> m_tolerances;
+    };
+
+} // namespace gblsim
+
+#endif /* TOLERANCE_H */
@@ -0,0 +1,214 @@
+#include "trackmodel.h"
+
+#include "log.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <stdexcept>
+
+using namespace gblsim;
+using namespace unilog;
+
+namespace {
+    // Number of measurements in each arm of the triplet model:
+    const double arm_points = 3.;
+} // namespace
+
+trackestimator::trackestimator(trackmodel model) : m_model(model) {
+    if(model == trackmodel::gbl) {
+        throw std::invalid_argument("the GBL track model has no closed form");
+    }
+}
+
+modelresolution trackestimator::evaluate(const chain& points, size_t point, size_t axis) const {
+    std::vector<modelresolution> results{{std::numeric_limits<double>::infinity(), std::numeric_limits<double>::infinity()}};
+    if(point < points.size()) {
+        evaluate(std::vector<const chain*>{&points}, point, axis, results);
+    }
+    return results.front();
+}
+
+std::vector<modelresolution> trackestimator::evaluate(const std::vector<chain>& chains, size_t point, size_t axis) const {
+
+    std::vector<modelresolution> results(
+        chains.size(), {std::numeric_limits<double>::infinity(), std::numeric_limits<double>::infinity()});
+
+    // Group the configurations by the number of points of their chain:
+    std::map<size_t, std::vector<size_t>> groups;
+    for(size_t i = 0; i < chains.size(); i++) {
+        if(point < chains[i].size()) {
+            groups[chains[i].size()].push_back(i);
+        }
+    }
+
+    std::vector<modelresolution> group_results;
+    for(const auto& group : groups) {
+        std::vector<const chain*> members;
+        for(const auto& i : group.second) {
+            members.push_back(&chains[i]);
+        }
+        evaluate(members, point, axis, group_results);
+        for(size_t k = 0; k < members.size(); k++) {
+            results[group.second[k]] = group_results[k];
+        }
+    }
+
+    LOG(DEBUG) << "Estimated " << chains.size() << " configurations in " << groups.size() << " groups with the "
+               << (m_model == trackmodel::triplet ? "triplet" : "straight line") << " model";
+    return results;
+}
+
+void trackestimator::evaluate(const std::vector<const chain*>& chains,
+                              size_t point,
+                              size_t axis,
+                              std::vector<modelresolution>& results) const {
+
+    auto lanes = chains.size();
+    auto points = chains.front()->size();
+    const double arm = (m_model == trackmodel::triplet) ? arm_points : static_cast<double>(points);
+
+    // Input field by field with the configurations as innermost dimension. Positions are taken relative to the point, a
+    // kink precision of infinity becomes a vanishing kink variance and a free kink an infinite one:
+    std::vector<double> z(points * lanes), measurement(points * lanes), variance(points * lanes);
+    for(size_t l = 0; l < lanes; l++) {
+        const auto& points_l = *chains[l];
+        for(size_t p = 0; p < points; p++) {
+            z[p * lanes + l] = points_l.getPosition(p) - points_l.getPosition(point);
+            measurement[p * lanes + l] = points_l.getMeasurement(p, axis);
+            variance[p * lanes + l] = 1. / points_l.getScatterer(p);
+        }
+    }
+
+    // Weights of the measurements in the upstream and downstream fits, taken from the closest measurements on each side:
+    std::vector<double> upstream(points * lanes, 0.), downstream(points * lanes, 0.);
+    std::vector<double> count(lanes);
+    auto select = [&](size_t p, std::vector<double>& weight) {
+        const double* m = measurement.data() + p * lanes;
+        double* w = weight.data() + p * lanes;
+        for(size_t l = 0; l < lanes; l++) {
+            bool use = (m[l] > 0.) && (count[l] < arm);
+            w[l] = use ? m[l] : 0.;
+            count[l] += use ? 1. : 0.;
+        }
+    };
+    std::fill(count.begin(), count.end(), 0.);
+    for(size_t p = point; p-- > 0;) {
+        select(p, upstream);
+    }
+    std::fill(count.begin(), count.end(), 0.);
+    for(size_t p = point + 1; p < points; p++) {
+        select(p, downstream);
+    }
+
+    // Weighted straight line fit with the given weights, its coefficients for position and slope at the point are
+    // w_i (S2 - S1 z_i) / det and w_i (S0 z_i - S1) / det. Fits with less than two measurements are invalid:
+    struct linefit {
+        std::vector<double> s0, s1, s2, valid;
+    };
+    auto fit = [&](const std::vector<double>& weight) {
+        linefit line{std::vector<double>(lanes, 0.),
+                     std::vector<double>(lanes, 0.),
+                     std::vector<double>(lanes, 0.),
+                     std::vector<double>(lanes, 0.)};
+        std::vector<double> used(lanes, 0.);
+        for(size_t p = 0; p < points; p++) {
+            const double* w = weight.data() + p * lanes;
+            const double* zp = z.data() + p * lanes;
+            for(size_t l = 0; l < lanes; l++) {
+                line.s0[l] += w[l];
+                line.s1[l] += w[l] * zp[l];
+                line.s2[l] += w[l] * zp[l] * zp[l];
+                used[l] += (w[l] > 0.) ? 1. : 0.;
+            }
+        }
+        for(size_t l = 0; l < lanes; l++) {
+            double det = line.s0[l] * line.s2[l] - line.s1[l] * line.s1[l];
+            bool valid = (used[l] >= 2.) && (det > 0.);
+            // Fold the inverse determinant into the sums, invalid fits get vanishing coefficients:
+            double inverse = valid ? 1. / det : 0.;
+            line.s0[l] *= inverse;
+            line.s1[l] *= inverse;
+            line.s2[l] *= inverse;
+            line.valid[l] = valid ? 1. : 0.;
+        }
+        return line;
+    };
+    auto up = fit(upstream);
+    auto down = fit(downstream);
+    auto all = fit(measurement);
+
+    // Coefficients of every measurement in the position and kink estimates, and the weight of each arm in the position:
+    std::vector<double> position(points * lanes), kink(points * lanes);
+    std::vector<double> up_weight(lanes), down_weight(lanes), position_valid(lanes), kink_valid(lanes);
+    for(size_t l = 0; l < lanes; l++) {
+        double arms = up.valid[l] + down.valid[l];
+        up_weight[l] = up.valid[l] / std::max(arms, 1.);
+        down_weight[l] = down.valid[l] / std::max(arms, 1.);
+        position_valid[l] = (m_model == trackmodel::triplet) ? std::min(arms, 1.) : all.valid[l];
+        kink_valid[l] = up.valid[l] * down.valid[l];
+    }
+    // First measurement entering each estimate, the estimates are blind to kinks in front of it as the fits reproduce
+    // straight lines:
+    std::vector<double> position_first(lanes, static_cast<double>(points)), kink_first(lanes, static_cast<double>(points));
+    const bool triplet = (m_model == trackmodel::triplet);
+    for(size_t p = points; p-- > 0;) {
+        const double* zp = z.data() + p * lanes;
+        const double* m = measurement.data() + p * lanes;
+        const double* wu = upstream.data() + p * lanes;
+        const double* wd = downstream.data() + p * lanes;
+        double* cp = position.data() + p * lanes;
+        double* ck = kink.data() + p * lanes;
+        for(size_t l = 0; l < lanes; l++) {
+            double cu = wu[l] * (up.s2[l] - up.s1[l] * zp[l]);
+            double cd = wd[l] * (down.s2[l] - down.s1[l] * zp[l]);
+            double ca = m[l] * (all.s2[l] - all.s1[l] * zp[l]);
+            cp[l] = triplet ? up_weight[l] * cu + down_weight[l] * cd : ca;
+            ck[l] = wd[l] * (down.s0[l] * zp[l] - down.s1[l]) - wu[l] * (up.s0[l] * zp[l] - up.s1[l]);
+            position_first[l] = (cp[l] != 0.) ? static_cast<double>(p) : position_first[l];
+            kink_first[l] = (ck[l] != 0.) ? static_cast<double>(p) : kink_first[l];
+        }
+    }
+
+    // Backward pass accumulating the displacements every scatterer causes at the measurements downstream of it, the
+    // error of the estimate is s = sum_i c_i (z_i - z_k) minus the displacement or kink of the true track at the point:
+    std::vector<double> position_variance(lanes, 0.), kink_variance(lanes, 0.);
+    std::vector<double> position_moment(lanes, 0.), position_sum(lanes, 0.), kink_moment(lanes, 0.), kink_sum(lanes, 0.);
+    for(size_t p = points; p-- > 0;) {
+        const double* zp = z.data() + p * lanes;
+        const double* m = measurement.data() + p * lanes;
+        const double* v = variance.data() + p * lanes;
+        const double* cp = position.data() + p * lanes;
+        const double* ck = kink.data() + p * lanes;
+        const double at_point = (p == point) ? 1. : 0.;
+        const double index = static_cast<double>(p);
+        const bool behind = (p > point);
+        for(size_t l = 0; l < lanes; l++) {
+            // Measurement noise, the coefficients carry the weight of the measurement:
+            double inverse = (m[l] > 0.) ? 1. / m[l] : 0.;
+            position_variance[l] += cp[l] * cp[l] * inverse;
+            kink_variance[l] += ck[l] * ck[l] * inverse;
+
+            position_moment[l] += cp[l] * zp[l];
+            position_sum[l] += cp[l];
+            kink_moment[l] += ck[l] * zp[l];
+            kink_sum[l] += ck[l];
+            double sp = position_moment[l] - zp[l] * position_sum[l] - std::max(-zp[l], 0.);
+            double sk = kink_moment[l] - zp[l] * kink_sum[l] - at_point;
+            // Scatterers the estimate is blind to do not contribute, even if their kink is free. This covers the kinks
+            // in front of all measurements and the point, and those behind all measurements with vanishing sums:
+            bool position_blind = (sp == 0.) || (index <= position_first[l] && !behind);
+            bool kink_blind = (sk == 0.) || (index < kink_first[l]);
+            position_variance[l] += position_blind ? 0. : sp * sp * v[l];
+            kink_variance[l] += kink_blind ? 0. : sk * sk * v[l];
+        }
+    }
+
+    results.resize(lanes);
+    const double infinity = std::numeric_limits<double>::infinity();
+    for(size_t l = 0; l < lanes; l++) {
+        results[l].position = (position_valid[l] > 0.) ? std::sqrt(position_variance[l]) * 1E3 : infinity;
+        results[l].kink = (kink_valid[l] > 0.) ? std::sqrt(kink_variance[l]) * 1E6 : infinity;
+    }
+}
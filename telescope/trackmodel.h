@@ -0,0 +1,64 @@
+#ifndef TRACKMODEL_H
+#define TRACKMODEL_H
+
+#include <vector>
+
+#include "smoother.h"
+
+namespace gblsim {
+
+    // Track model used to estimate the track at a plane
+    enum class trackmodel {
+        // General broken lines fit of all measurements and scatterers, the reference
+        gbl,
+        // Straight line fit of all measurements ignoring the scattering, e.g. for a first alignment
+        straightline,
+        // Straight lines through the three measurements closest to the plane on either side, i.e. the triplet and driplet
+        // of the two arms of a DATURA-like telescope, as used by many reconstruction frameworks
+        triplet,
+    };
+
+    // Resolution of a cheap track model at one point
+    struct modelresolution {
+        // Position resolution in [um] and kink resolution in [urad], infinite if the model does not constrain the track
+        double position;
+        double kink;
+    };
+
+    // Closed-form resolution of the cheap track models, e.g. to screen many layouts before running the GBL fit on the
+    // best ones, or to compare with the resolution seen by reconstruction software.
+    // Every model estimates position and slope as weighted straight line fits, linear in the measurements. As the fits
+    // reproduce straight tracks exactly, the error of the estimate is the measurement noise propagated through the fit
+    // plus the displacement every scatterer causes at the measurements, relative to the one at the point. The resolution
+    // therefore includes the scattering the models ignore and is the true width of their residuals, not the width the
+    // fit claims. The position is the straight line fit of all measurements for the straight line model and the mean of
+    // the extrapolated triplet and driplet, or the only one available, for the triplet model. The kink is the difference
+    // between the slopes of the downstream and upstream fits, for the straight line model using all measurements on
+    // either side. Measurements at the point itself only enter the straight line position.
+    // Chains with the same number of points are evaluated together with the configurations as innermost dimension and
+    // without branches, so all passes run on full SIMD lanes. Free kinks within reach of the fits, e.g. those of unknown
+    // targets, give infinite resolution since a straight line cannot absorb them.
+    class trackestimator {
+    public:
+        // Estimator for the given model, throws for the GBL model which has no closed form
+        explicit trackestimator(trackmodel model);
+
+        // Return the resolution along the given axis at the given point of the chain
+        modelresolution evaluate(const chain& points, size_t point, size_t axis) const;
+        // Return the resolution along the given axis at the given point of every chain, chains without this point are
+        // returned with infinite resolution
+        std::vector<modelresolution> evaluate(const std::vector<chain>& chains, size_t point, size_t axis) const;
+
+    private:
+        // Evaluate the given chains, all of the same size
+        void evaluate(const std::vector<const chain*>& chains,
+                      size_t point,
+                      size_t axis,
+                      std::vector<modelresolution>& results) const;
+
+        trackmodel m_model;
+    };
+
+} // namespace gblsim
+
+#endif /* TRACKMODEL_H */
@@ -0,0 +1,104 @@
+// Replacement of the global allocation functions counting heap allocations for the profiler. Not part of the library,
+// as it would replace the allocator of every process linking it: devices opt in with -DCOUNT_ALLOCATIONS=ON.
+
+#include "profiler.h"
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+using namespace gblsim;
+
+namespace {
+    void* allocate(std::size_t size, std::size_t alignment) {
+        profiler::count(profiler::counter::allocations);
+        size = (size > 0 ? size : 1);
+        while(true) {
+            void* pointer = nullptr;
+            if(alignment <= alignof(std::max_align_t)) {
+                pointer = std::malloc(size);
+            } else {
+                // The size has to be a multiple of the alignment:
+                pointer = std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+            }
+            if(pointer != nullptr) {
+                return pointer;
+            }
+            auto handler = std::get_new_handler();
+            if(handler == nullptr) {
+                throw std::bad_alloc();
+            }
+            handler();
+        }
+    }
+
+    void* allocate(std::size_t size, std::size_t alignment, const std::nothrow_t&) noexcept {
+        try {
+            return allocate(size, alignment);
+        } catch(...) {
+            return nullptr;
+        }
+    }
+} // namespace
+
+void* operator new(std::size_t size) {
+    return allocate(size, alignof(std::max_align_t));
+}
+void* operator new[](std::size_t size) {
+    return allocate(size, alignof(std::max_align_t));
+}
+void* operator new(std::size_t size, const std::nothrow_t& tag) noexcept {
+    return allocate(size, alignof(std::max_align_t), tag);
+}
+void* operator new[](std::size_t size, const std::nothrow_t& tag) noexcept {
+    return allocate(size, alignof(std::max_align_t), tag);
+}
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    return allocate(size, static_cast<std::size_t>(alignment));
+}
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+    return allocate(size, static_cast<std::size_t>(alignment));
+}
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t& tag) noexcept {
+    return allocate(size, static_cast<std::size_t>(alignment), tag);
+}
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t& tag) noexcept {
+    return allocate(size, static_cast<std::size_t>(alignment), tag);
+}
+
+void operator delete(void* pointer) noexcept {
+    std::free(pointer);
+}
+void operator delete[](void* pointer) noexcept {
+    std::free(pointer);
+}
+void operator delete(void* pointer, std::size_t) noexcept {
+    std::free(pointer);
+}
+void operator delete[](void* pointer, std::size_t) noexcept {
+    std::free(pointer);
+}
+void operator delete(void* pointer, const std::nothrow_t&) noexcept {
+    std::free(pointer);
+}
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept {
+    std::free(pointer);
+}
+void operator delete(void* pointer, std::align_val_t) noexcept {
+    std::free(pointer);
+}
+void operator delete[](void* pointer, std::align_val_t) noexcept {
+    std::free(pointer);
+}
+void operator delete(void* pointer, std::size_t, std::align_val_t) noexcept {
+    std::free(pointer);
+}
+void operator delete[](void* pointer, std::size_t, std::align_val_t) noexcept {
+    std::free(pointer);
+}
+void operator delete(void* pointer, std::align_val_t, const std::nothrow_t&) noexcept {
+    std::free(pointer);
+}
+void operator delete[](void* pointer, std::align_val_t, const std::nothrow_t&) noexcept {
+    std::free(pointer);
+}
@@ -0,0 +1,32 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <cstdint>
+#include <string>
+
+namespace gblsim {
+
+    // Incremental 64 bit FNV-1a hash, used to identify configurations and geometries
+    class hasher {
+    public:
+        hasher& add(const void* data, size_t size) {
+            const auto* bytes = static_cast<const unsigned char*>(data);
+            for(size_t i = 0; i < size; i++) {
+                m_hash ^= bytes[i];
+                m_hash *= 1099511628211ULL;
+            }
+            return *this;
+        }
+        hasher& add(double value) { return add(&value, sizeof(value)); }
+        hasher& add(uint64_t value) { return add(&value, sizeof(value)); }
+        hasher& add(const std::string& value) { return add(value.data(), value.size()); }
+
+        uint64_t value() const { return m_hash; }
+
+    private:
+        uint64_t m_hash{14695981039346656037ULL};
+    };
+
+} // namespace gblsim
+
+#endif /* HASH_H */
@@ -26,4 +26,39 @@
 // http://personalpages.to.infn.it/~tosello/EngMeet/ITSmat/SDD/SDD_G10FR4.html
 #define X0_PCB 167.608
 
+// Parameters of the mean ionization energy loss, Z/A, mean excitation energy I [eV] and density [g/cm3]
+// http://pdg.lbl.gov/2015/AtomicNuclearProperties/
+#define ZA_Si 0.49848
+#define I_Si 173.0
+#define RHO_Si 2.329
+
+#define ZA_Diamond 0.49955
+#define I_Diamond 78.0
+#define RHO_Diamond 3.520
+
+#define ZA_Al 0.48181
+#define I_Al 166.0
+#define RHO_Al 2.699
+
+#define ZA_Au 0.40108
+#define I_Au 790.0
+#define RHO_Au 19.32
+
+#define ZA_Cu 0.45636
+#define I_Cu 322.0
+#define RHO_Cu 8.960
+
+#define ZA_Air 0.49919
+#define I_Air 85.7
+#define RHO_Air 1.205E-3
+
+#define ZA_Kapton 0.51264
+#define I_Kapton 79.6
+#define RHO_Kapton 1.420
+
+// PCB (FR4), approximated by G10
+#define ZA_PCB 0.52
+#define I_PCB 98.0
+#define RHO_PCB 1.85
+
 #endif /* MATERIAL_H */
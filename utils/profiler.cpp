@@ -0,0 +1,153 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+using namespace gblsim;
+
+std::atomic<bool> profiler::m_enabled{false};
+
+namespace {
+
+    // Accumulators of one thread, shared by all threads beyond the capacity of the registry:
+    struct storage {
+        std::array<std::atomic<uint64_t>, profiler::phases> calls;
+        std::array<std::atomic<uint64_t>, profiler::phases> cycles;
+        std::array<std::atomic<uint64_t>, profiler::counters> counts;
+    };
+
+    // Registry of the storage of all threads. Storage is allocated without operator new, as allocations may be counted
+    // themselves by the allocation hook, and outlives its thread so the summary can be written at exit:
+    constexpr size_t max_threads = 1024;
+    std::array<std::atomic<storage*>, max_threads> registry{};
+    std::atomic<size_t> registered{0};
+
+    storage& local() {
+        thread_local storage* local = nullptr;
+        if(local == nullptr) {
+            auto slot = registered.fetch_add(1);
+            if(slot < max_threads) {
+                local = new(std::calloc(1, sizeof(storage))) storage();
+                registry[slot].store(local);
+            } else {
+                // Threads beyond the capacity share the last storage, their numbers are approximate:
+                storage* shared = nullptr;
+                while((shared = registry[max_threads - 1].load()) == nullptr) {
+                }
+                local = shared;
+            }
+        }
+        return *local;
+    }
+
+    void increment(std::atomic<uint64_t>& value, uint64_t n) {
+        value.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    std::string& output() {
+        static std::string path;
+        return path;
+    }
+
+    // Reference points to convert cycles to seconds:
+    std::chrono::steady_clock::time_point start_time;
+    uint64_t start_cycles = 0;
+
+    const std::array<const char*, profiler::phases> phase_names = {
+        "sorting", "material", "points", "trajectory", "fit", "results", "output"};
+    const std::array<const char*, profiler::counters> counter_names = {
+        "telescopes", "points", "fits", "results", "allocations"};
+
+} // namespace
+
+void profiler::enable(const std::string& path) {
+    output() = path;
+    start_time = std::chrono::steady_clock::now();
+    start_cycles = cycles();
+    m_enabled.store(true);
+
+    // Write the summary at exit, registered only once:
+    static const int registered_exit = std::atexit(profiler::write);
+    static_cast<void>(registered_exit);
+}
+
+uint64_t profiler::cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+void profiler::add(counter type, uint64_t n) {
+    increment(local().counts[static_cast<size_t>(type)], n);
+}
+
+void profiler::add(phase type, uint64_t n) {
+    auto& data = local();
+    increment(data.calls[static_cast<size_t>(type)], 1);
+    increment(data.cycles[static_cast<size_t>(type)], n);
+}
+
+void profiler::write() {
+    if(!enabled()) {
+        return;
+    }
+
+    // Sum up all threads:
+    std::array<uint64_t, phases> calls{}, cycles_total{};
+    std::array<uint64_t, counters> counts{};
+    auto threads = std::min(registered.load(), max_threads);
+    for(size_t slot = 0; slot < threads; slot++) {
+        const auto* data = registry[slot].load();
+        if(data == nullptr) {
+            continue;
+        }
+        for(size_t i = 0; i < phases; i++) {
+            calls[i] += data->calls[i].load(std::memory_order_relaxed);
+            cycles_total[i] += data->cycles[i].load(std::memory_order_relaxed);
+        }
+        for(size_t i = 0; i < counters; i++) {
+            counts[i] += data->counts[i].load(std::memory_order_relaxed);
+        }
+    }
+
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+    double rate = (wall > 0.) ? static_cast<double>(cycles() - start_cycles) / wall : 0.;
+
+    std::ofstream file(output());
+    file << "{\n";
+    file << "  \"threads\": " << threads << ",\n";
+    file << "  \"wall_seconds\": " << wall << ",\n";
+    file << "  \"cycles_per_second\": " << rate << ",\n";
+    file << "  \"phases\": {\n";
+    for(size_t i = 0; i < phases; i++) {
+        file << "    \"" << phase_names[i] << "\": {\"calls\": " << calls[i] << ", \"cycles\": " << cycles_total[i]
+             << ", \"seconds\": " << (rate > 0. ? static_cast<double>(cycles_total[i]) / rate : 0.) << "}"
+             << (i + 1 < phases ? "," : "") << "\n";
+    }
+    file << "  },\n";
+    file << "  \"counters\": {\n";
+    for(size_t i = 0; i < counters; i++) {
+        file << "    \"" << counter_names[i] << "\": " << counts[i] << (i + 1 < counters ? "," : "") << "\n";
+    }
+    file << "  },\n";
+
+    // Average per telescope to size batch jobs:
+    auto telescopes = static_cast<double>(counts[static_cast<size_t>(counter::telescopes)]);
+    file << "  \"per_telescope\": {\n";
+    for(size_t i = 1; i < counters; i++) {
+        double average = (telescopes > 0. ? static_cast<double>(counts[i]) / telescopes : 0.);
+        file << "    \"" << counter_names[i] << "\": " << average << (i + 1 < counters ? "," : "") << "\n";
+    }
+    file << "  }\n";
+    file << "}\n";
+}
@@ -0,0 +1,83 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace gblsim {
+
+    // Lightweight instrumentation of the phases of a simulation.
+    // Time spent per phase is measured with the cycle counter of the processor and accumulated together with event
+    // counters in per-thread storage, so instrumented code never synchronizes. Profiling is enabled at runtime with
+    // enable(), e.g. from the command line of a device, and costs a single branch per instrumented call when disabled.
+    // A JSON summary of all threads is written at exit.
+    class profiler {
+    public:
+        enum class phase : size_t {
+            sorting = 0, // sorting of the planes along the beam
+            material,    // calculation of the total material budget
+            points,      // construction of the trajectory points
+            trajectory,  // construction of the GBL trajectory
+            fit,         // fit of the trajectory
+            results,     // retrieval of fit results
+            output,      // writing of output files
+        };
+        enum class counter : size_t {
+            telescopes = 0, // telescopes built
+            points,         // trajectory points built
+            fits,           // trajectory fits
+            results,        // retrievals of fit results
+            allocations,    // heap allocations, only counted with the allocation hook linked (utils/allochook.cpp)
+        };
+        static constexpr size_t phases = 7;
+        static constexpr size_t counters = 5;
+
+        // Enable profiling and write the summary to the given file at exit
+        static void enable(const std::string& path = "telressim-profile.json");
+        static bool enabled() { return m_enabled.load(std::memory_order_relaxed); }
+
+        static void count(counter type, uint64_t n = 1) {
+            if(enabled()) {
+                add(type, n);
+            }
+        }
+
+        // Return the current value of the cycle counter
+        static uint64_t cycles();
+
+        // Write the summary of all threads to the configured file
+        static void write();
+
+        // Accumulate the time spent in its lifetime to the given phase
+        class scope {
+        public:
+            explicit scope(phase type) : m_phase(type), m_start(enabled() ? cycles() : 0) {}
+            ~scope() {
+                if(m_start > 0) {
+                    add(m_phase, cycles() - m_start);
+                }
+            }
+
+            scope(const scope&) = delete;
+            scope& operator=(const scope&) = delete;
+
+        private:
+            phase m_phase;
+            uint64_t m_start;
+        };
+
+    private:
+        static void add(counter type, uint64_t n);
+        static void add(phase type, uint64_t cycles);
+
+        static std::atomic<bool> m_enabled;
+    };
+
+} // namespace gblsim
+
+// Profile the remainder of the enclosing block as the given phase
+#define PROFILE(type) gblsim::profiler::scope profile_scope(gblsim::profiler::phase::type)
+
+#endif /* PROFILER_H */